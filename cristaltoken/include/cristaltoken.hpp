@@ -2,10 +2,19 @@
 
 #include <eosio/asset.hpp>
 #include <eosio/eosio.hpp>
+#include <eosio/singleton.hpp>
 
 #include <eosio/system.hpp>
 
-#include <cmath>
+#include <errors.hpp>
+#include <profile.hpp>
+#include <versioned.hpp>
+
+#include <limits>
+#include <map>
+#include <optional>
+#include <variant>
+#include <vector>
 
 namespace eosiosystem {
    class system_contract;
@@ -42,6 +51,7 @@ namespace eosio {
           * @pre Maximum supply must be positive;
           *
           * If validation is successful a new entry in statstable for token symbol scope gets created.
+          * The first token created becomes the contract token (see `xfer` and `setconfig`).
           */
          [[eosio::action]]
          void create( const name&   issuer,
@@ -50,8 +60,9 @@ namespace eosio {
           * Issue action.
           *
           * @details This action issues to `to` account a `quantity` of tokens.
+          * `to` is credited directly (no inline transfer from the issuer) and notified.
           *
-          * @param to - the account to issue tokens to, it must be the same as the issuer,
+          * @param to - the account to issue tokens to,
           * @param quntity - the amount of tokens to be issued,
           * @memo - the memo string that accompanies the token issue transaction.
           */
@@ -70,22 +81,97 @@ namespace eosio {
          [[eosio::action]]
          void retire( const asset& quantity, const string& memo );
 
+         /**
+          * Balances after a `transfer` or `xfer`, returned as the action return value so
+          * clients need not read the `accounts` table again.
+          */
+         struct transfer_result {
+            asset    from_balance;
+            asset    to_balance;
+         };
+
          /**
           * Transfer action.
           *
           * @details Allows `from` account to transfer to `to` account the `quantity` tokens.
           * One account is debited and the other is credited with quantity tokens.
+          * If `from` is a customer with a positive `fee` of the same token, `from` is also
+          * debited the fee, which is accrued in the `feepool` table until `settlefees`.
+          * Sent inline by the contract itself, it is the record of an `issue` to another account:
+          * nothing moves, `from` and `to` are only notified.
           *
           * @param from - the account to transfer from,
           * @param to - the account to be transferred to,
           * @param quantity - the quantity of tokens to be transferred,
           * @param memo - the memo string to accompany the transaction.
+          *
+          * @return the new balances of `from` (fee included) and `to`.
           */
          [[eosio::action]]
-         void transfer( const name&    from,
-                        const name&    to,
-                        const asset&   quantity,
-                        const string&  memo );
+         transfer_result transfer( const name&    from,
+                                   const name&    to,
+                                   const asset&   quantity,
+                                   const string&  memo );
+         /**
+          * Compact transfer action.
+          *
+          * @details Same as `transfer` for the contract token (set by `create` or `setconfig`):
+          * `amount` is in the token's smallest unit and `ref` is an optional (0 for none)
+          * numeric reference in place of the memo, so the action data is 32 bytes.
+          *
+          * @param from - the account to transfer from,
+          * @param to - the account to be transferred to,
+          * @param amount - the amount of contract tokens to be transferred,
+          * @param ref - the caller's reference of the transfer, only recorded in the action data.
+          *
+          * @return the new balances of `from` and `to`, as `transfer`.
+          */
+         [[eosio::action]]
+         transfer_result xfer( const name&      from,
+                               const name&      to,
+                               const int64_t&   amount,
+                               const uint64_t&  ref );
+
+         /**
+          * Set config action.
+          *
+          * @details Sets the contract token used by `xfer` and by packed customer rows. Only
+          * needed by contracts deployed before `create` recorded it; once set it cannot be
+          * changed, since packed customer amounts carry no symbol.
+          *
+          * @param token - the symbol of an existing token.
+          */
+         [[eosio::action]]
+         void setconfig( const symbol& token );
+
+         /**
+          * Single payout of a `transferbatch` action.
+          */
+         struct payout {
+            name     to;
+            asset    quantity;
+            string   memo;
+         };
+
+         /**
+          * Transfer batch action.
+          *
+          * @details Allows `from` account to pay several accounts in one action (payroll, merchant settlement).
+          * The token symbol is validated once, `from` is debited once with the total of all payouts
+          * and every recipient is credited with its own quantity. A batch paid by the bank (the
+          * contract account or a bank admin customer) is bank initiated: recipients that opted
+          * out with `setnotify` are not notified.
+          *
+          * @param from - the account to transfer from,
+          * @param payouts - the recipients, quantities and memos to be paid.
+          *
+          * @pre All payouts have to be of the same token symbol,
+          * @pre `from` balance has to cover the total of all payouts, plus its customer fee once per payout.
+          */
+         [[eosio::action]]
+         void transferbatch( const name&                 from,
+                             const std::vector<payout>&  payouts );
+
          /**
           * Open action.
           *
@@ -117,6 +203,51 @@ namespace eosio {
          [[eosio::action]]
          void close( const name& owner, const symbol& symbol );
 
+         /**
+          * Result of `audit`. Totals are running totals until `done`; `balanced` tells whether
+          * `balances` plus `fees` equals `supply` once the walk ended, and is false before.
+          */
+         struct audit_result {
+            bool      done;
+            uint64_t  holders;
+            asset     balances;
+            asset     fees;
+            asset     supply;
+            bool      balanced;
+         };
+
+         /**
+          * Audit action.
+          *
+          * @details Checks that the balances of every holder of token `sym`, plus the fees accrued
+          * in the `feepool` table, add up to its supply. At most `max_rows` holders are summed per
+          * call: the position in the `holders` registry and the running sum are kept in the
+          * auditstate singleton so the next call resumes where this one stopped, and balance
+          * changes of the holders already summed are applied to the running sum meanwhile. The
+          * call that ends the walk compares the totals, erases the singleton and returns them.
+          *
+          * @param sym - the token to audit,
+          * @param max_rows - the maximum number of holders to sum in this call.
+          *
+          * @pre Holders whose balance row predates the registry have to be registered with `regholders`.
+          */
+         [[eosio::action]]
+         audit_result audit( const symbol_code& sym, const uint32_t& max_rows );
+
+         /**
+          * Register holders action.
+          *
+          * @details Adds `owners` to the `holders` registry of token `sym` walked by `audit`.
+          * Balance rows are registered when they are created; this registers the ones created
+          * before the registry existed (e.g. the owners listed in the accounts.csv of tabledump).
+          * Owners already registered are skipped.
+          *
+          * @param sym - the token,
+          * @param owners - the accounts to register, each with a balance row of `sym`.
+          */
+         [[eosio::action]]
+         void regholders( const symbol_code& sym, const std::vector<name>& owners );
+
          /**
           * Get supply method.
           *
@@ -160,6 +291,15 @@ namespace eosio {
          constexpr static   uint32_t     STATE_ENABLED              = 1;
          constexpr static   uint32_t     STATE_BLOCKED              = 0;
 
+         constexpr static   uint8_t      PAP_FLAG_ENABLED           = 1;
+         constexpr static   uint8_t      CUST_FLAG_NO_NOTIFY        = 1;
+         constexpr static   uint8_t      CUST_FLAG_CREDIT_LINE      = 2;    // overdraft not issued, see retire_overdraft
+         constexpr static   uint8_t      CONFIG_FLAG_PAPS_MIGRATED  = 1;
+         constexpr static   uint8_t      CONFIG_FLAG_CUSTS_MIGRATED = 2;
+         constexpr static   uint32_t     PAP_PRUNE_GRACE            = 90*DAYS_IN_SECONDS;
+         constexpr static   uint32_t     PAP_PRUNE_ROWS_PER_CHARGE  = 2;
+         constexpr static   uint64_t     PAP_DUE_INACTIVE           = uint64_t(1) << 32;  // bydue keys of finished and blocked PAPs
+
          static inline time_point_sec now() {
            return time_point_sec(current_time_point());
          }
@@ -191,19 +331,118 @@ namespace eosio {
                       , const name&       to
                       , const uint32_t&   service_id
                       , const string&     memo);         
+         /**
+         * State after a `chargepap` or `catchuppap`, returned as the action return value: the
+         * new balances, the periods charged so far and still to charge, and the time from which
+         * the next period can be charged (zero once every period is charged).
+         */
+         struct charge_result {
+            asset            from_balance;
+            asset            to_balance;
+            uint16_t         last_charged;
+            uint16_t         remaining;
+            time_point_sec   next_due;
+         };
+
          /**
          * Charge method for @provider to get paid for @service_id provided to @account in the next billable month/period.
          * @account 
          * @provider
          * @service_id
+         * @return the post-state of the charge (charge_result).
          */
          [[eosio::action]]
-         void chargepap(const name&       from
-                      , const name&       to
+         charge_result chargepap(const name&       from
+                               , const name&       to
+                               , const uint32_t&   service_id
+                               , const asset&      quantity
+                               , const string&     memo);
+
+         /**
+         * Catch-up charge method for @provider to get paid for every period of @service_id that
+         * is due and not charged yet, at most @max_periods of them, in one action. The number
+         * of due periods is computed from begins_at and capped by the contract periods;
+         * @account is debited once with @quantity (the agreed price) times the charged periods,
+         * plus its fee once per charged period, as if each period had been charged by chargepap.
+         * @account
+         * @provider
+         * @service_id
+         * @quantity
+         * @max_periods
+         */
+         [[eosio::action]]
+         charge_result catchuppap(const name&      from
+                               , const name&       to
+                               , const uint32_t&   service_id
+                               , const asset&      quantity
+                               , const uint32_t&   max_periods
+                               , const string&     memo);
+
+         /**
+         * Bulk charge method for @provider to get paid for every due PAP of @service_id.
+         * Walks the PAPs of @provider / @service_id charging the ones that are due and funded,
+         * once the legacy `pap` table has been emptied by migratepaps (it only walks `paps`),
+         * visiting at most @max_rows rows. The position is persisted in the chargecursor table
+         * so the next call resumes where this one stopped; the row is erased once the walk ends.
+         * The provider is credited once per call with the total charged.
+         * @provider
+         * @service_id
+         * @max_rows
+         */
+         [[eosio::action]]
+         void chargeall(const name&       provider
                       , const uint32_t&   service_id
-                      , const asset&      quantity
+                      , const uint32_t&   max_rows
                       , const string&     memo);
 
+         /**
+         * Migrate method that upgrades at most @max_rows PAPs: rows of the legacy `pap` table
+         * are moved to the versioned `paps` table first, keeping their ids, then `paps` rows
+         * stored with an older layout are rewritten with the newest one. The walk over `paps`
+         * is persisted in the papcursor singleton, erased once the walk ends. Legacy rows are
+         * also moved the first time upsertpap, erasepap or chargepap touch them, and every write
+         * of a `paps` row uses the newest layout, so only cold rows need this. The call that finds the legacy table empty records it in the config
+         * flags; from then on lookups skip that table.
+         * @max_rows
+         */
+         [[eosio::action]]
+         void migratepaps(const uint32_t& max_rows);
+
+         /**
+         * Garbage collection method that erases at most @max_rows finished PAPs, and blocked PAPs
+         * disabled more than PAP_PRUNE_GRACE seconds ago. Only the rows that sort last in bydue
+         * (finished, then blocked by disabled_at) are visited, up to the first one to keep, so
+         * no position is stored between calls. chargepap also prunes up to
+         * PAP_PRUNE_ROWS_PER_CHARGE rows on every charge. Fails until the legacy `pap` table
+         * has been emptied by migratepaps.
+         * @max_rows
+         */
+         [[eosio::action]]
+         void prunepaps(const uint32_t& max_rows);
+
+         /**
+         * Settle method that moves the fees accrued in the `feepool` table for token @sym
+         * into the balance of @to, a bank admin customer. Fees are accrued in a single row
+         * per token, so settling is a constant amount of work whatever the number of
+         * transfers charged since the last call.
+         * @to
+         * @sym
+         * @memo
+         */
+         [[eosio::action]]
+         void settlefees(const name&          to
+                          , const symbol_code& sym
+                          , const string&      memo);
+
+         /**
+         * Insert or Update customer method.
+         * @to
+         * @fee charged to the customer on every debit of its balance (see Fees in README.md)
+         * @overdraft credit line: while enabled, the customer balance may go down to -@overdraft.
+         * Changing it only updates the customer row, no tokens are issued or retired.
+         * @account_type
+         * @state
+         */
          [[eosio::action]]
          void upsertcust(const name&          to
                           , const asset&      fee
@@ -211,24 +450,107 @@ namespace eosio {
                           , const uint32_t&   account_type
                           , const uint32_t&   state
                           , const string&     memo);
+
+         /**
+          * Customer record of `upsertcusts`, the arguments of upsertcust but the memo.
+          */
+         struct customer_record {
+            name      to;
+            asset     fee;
+            asset     overdraft;
+            uint32_t  account_type;
+            uint32_t  state;
+         };
+
+         /**
+         * Bulk Insert or Update customer method: applies @customers in order, as many upsertcust
+         * would, under one authority check and with one `customers` table handle. Meant for
+         * onboarding whole customer bases; the batch size is bounded by the transaction CPU limit.
+         * @customers
+         */
+         [[eosio::action]]
+         void upsertcusts(const std::vector<customer_record>& customers);
          
          [[eosio::action]]
          void erasecust(  const name&   to
                         , const string& memo);
 
+         /**
+         * Notification preference method. With @notify false, @to is no longer notified
+         * (require_recipient) of the debits and credits the bank initiates: chargepap,
+         * catchuppap, chargeall, settlefees and the payouts of a transferbatch paid by the bank.
+         * Other transfers signed by an account always notify both sides. Customers are notified
+         * by default.
+         * @to customer, who may set it as well as the bank
+         * @notify
+         */
+         [[eosio::action]]
+         void setnotify(  const name&   to
+                        , const bool&   notify);
+
+         /**
+         * Migrate method that upgrades at most @max_rows customers: rows of the legacy `customer`
+         * table are moved to the versioned `customers` table first, then `customers` rows stored
+         * with an older layout are rewritten with the newest one. The walk over `customers` is
+         * persisted in the custcursor singleton, erased once the walk ends. Rows are also
+         * upgraded whenever upsertcust writes them. Rows keep their flags: customers onboarded
+         * when the overdraft was issued as tokens have no credit line until retireoft. The call
+         * that finds the legacy table empty records it in the config flags; from then on
+         * customer lookups skip that table.
+         * @max_rows
+         */
+         [[eosio::action]]
+         void migratecusts(const uint32_t& max_rows);
+
+         /**
+          * Overdraft issued to a customer as tokens, an entry of `retireoft`.
+          */
+         struct issued_overdraft {
+            name      to;
+            asset     quantity;
+         };
+
+         /**
+         * One-off retire method for customers onboarded when the overdraft was issued to their
+         * balance as tokens (memo "oft|create"). For each of @overdrafts it debits `quantity`
+         * out of the balance of `to` and retires it from the supply, then makes the customer
+         * overdraft a credit line (CUST_FLAG_CREDIT_LINE). `quantity` is the total issued to
+         * `to` under that memo, computed off chain from the issue history: the overdraft on the
+         * row may have been changed since without issuing or retiring anything. A zero
+         * `quantity` only grants the credit line. The balance may go down to -`quantity`, for
+         * issued tokens already spent. Fails for customers that already have a credit line.
+         * @overdrafts
+         */
+         [[eosio::action]]
+         void retireoft(const std::vector<issued_overdraft>& overdrafts);
+
          using upsertcust_action    = eosio::action_wrapper<"upsertcust"_n, &cristaltoken::upsertcust>;
+         using upsertcusts_action   = eosio::action_wrapper<"upsertcusts"_n, &cristaltoken::upsertcusts>;
          using erasecust_action     = eosio::action_wrapper<"erasecust"_n, &cristaltoken::erasecust>;
+         using setnotify_action     = eosio::action_wrapper<"setnotify"_n, &cristaltoken::setnotify>;
+         using migratecusts_action  = eosio::action_wrapper<"migratecusts"_n, &cristaltoken::migratecusts>;
+         using retireoft_action     = eosio::action_wrapper<"retireoft"_n, &cristaltoken::retireoft>;
+         using settlefees_action    = eosio::action_wrapper<"settlefees"_n, &cristaltoken::settlefees>;
 
          using upsertpap_action     = eosio::action_wrapper<"upsertpap"_n, &cristaltoken::upsertpap>;
          using erasepap_action      = eosio::action_wrapper<"erasepap"_n, &cristaltoken::erasepap>;
          using chargepap_action     = eosio::action_wrapper<"chargepap"_n, &cristaltoken::chargepap>;
+         using catchuppap_action    = eosio::action_wrapper<"catchuppap"_n, &cristaltoken::catchuppap>;
+         using chargeall_action     = eosio::action_wrapper<"chargeall"_n, &cristaltoken::chargeall>;
+         using migratepaps_action   = eosio::action_wrapper<"migratepaps"_n, &cristaltoken::migratepaps>;
+         using prunepaps_action     = eosio::action_wrapper<"prunepaps"_n, &cristaltoken::prunepaps>;
 
          using create_action        = eosio::action_wrapper<"create"_n, &cristaltoken::create>;
          using issue_action         = eosio::action_wrapper<"issue"_n, &cristaltoken::issue>;
          using retire_action        = eosio::action_wrapper<"retire"_n, &cristaltoken::retire>;
          using transfer_action      = eosio::action_wrapper<"transfer"_n, &cristaltoken::transfer>;
+         using transferbatch_action = eosio::action_wrapper<"transferbatch"_n, &cristaltoken::transferbatch>;
+         using xfer_action          = eosio::action_wrapper<"xfer"_n, &cristaltoken::xfer>;
+         using setconfig_action     = eosio::action_wrapper<"setconfig"_n, &cristaltoken::setconfig>;
          using open_action          = eosio::action_wrapper<"open"_n, &cristaltoken::open>;
          using close_action         = eosio::action_wrapper<"close"_n, &cristaltoken::close>;
+         using audit_action         = eosio::action_wrapper<"audit"_n, &cristaltoken::audit>;
+         using regholders_action    = eosio::action_wrapper<"regholders"_n, &cristaltoken::regholders>;
 
       private:
          
@@ -246,19 +568,166 @@ namespace eosio {
             uint64_t primary_key()const { return supply.symbol.code().raw(); }
          };
 
-         typedef eosio::multi_index< "accounts"_n, account > accounts;
-         typedef eosio::multi_index< "stat"_n, currency_stats > stats;
+         typedef profile::profiled_multi_index< "accounts"_n, account > accounts;
+         typedef profile::profiled_multi_index< "stat"_n, currency_stats > stats;
+
+         // Contract settings: the token `xfer` transfers (empty until `create` or `setconfig`
+         // records it) and CONFIG_FLAG_* bits.
+         struct [[eosio::table]] config {
+            symbol   token;
+            uint8_t  flags = 0;
+
+            bool has_token() const { return token.raw() != 0; }
+         };
+
+         typedef profile::profiled_singleton< "config"_n, config > configs;
+
+         // Accounts with a balance row of a token, scoped by the symbol code. Balances are scoped
+         // by owner and scopes cannot be listed on chain, so audit walks this registry instead.
+         struct [[eosio::table]] holder {
+            name     owner;
+
+            uint64_t primary_key()const { return owner.value; }
+         };
+
+         typedef profile::profiled_multi_index< "holders"_n, holder > holders;
+
+         // Running state of an unfinished audit, scoped by the symbol code: the balances of the
+         // holders before `next` are summed in `balances`.
+         struct [[eosio::table]] auditstate {
+            name     next;
+            uint64_t holders;
+            asset    balances;
+         };
+
+         typedef profile::profiled_singleton< "auditstate"_n, auditstate > auditstates;
 
-         void sub_balance( const name& owner, const asset& value );
-         void add_balance( const name& owner, const asset& value, const name& ram_payer );
-         void transfer_impl( const name&    from,
-                        const name&    to,
-                        const asset&   quantity,
-                        const string&  memo  );
+         asset sub_balance( const name& owner, const asset& value, const int64_t& credit );
+         asset add_balance( const name& owner, const asset& value, const name& ram_payer );
+         asset balance_of( const name& owner, const symbol& sym );
+         void issue_impl( const name& to, const asset& quantity, const string& memo );
+         transfer_result transfer_impl( const name&    from,
+                                   const name&    to,
+                                   const asset&   quantity,
+                                   const string&  memo,
+                                   const bool&    internal,
+                                   const uint32_t& debits = 1 );
          void send_summary(const name& user, const string& message);
+         asset customer_fee( const name& owner, const symbol& sym );
+         void accrue_fee( const asset& fee );
+         void register_holder( const name& owner, const symbol_code& sym, const name& ram_payer );
+         void audit_moved( const name& owner, const asset& delta );
+
+        // A Pre Authorized Payment, as read from the `paps` table whatever the layout of its row.
+        //
+        // periods and last_charged fit in 16 bits (more than 5000 years of 30 day periods)
+        // and the enabled state is a bit of `flags`; disabled_at is when the bit was last
+        // cleared (zero while enabled). An account/provider/service triplet is
+        // found through byaccserv, checking the provider of the (rare) rows that share the
+        // same account and service, so no 256-bit key is needed.
+        struct pap {
+          uint64_t        id;
+          name            account;
+          name            provider;
+          uint32_t        service_id;
+          asset           price;
+          time_point_sec  begins_at;
+          uint16_t        periods;
+          uint16_t        last_charged;
+          uint8_t         flags;
+          time_point_sec  disabled_at;
+
+          bool enabled() const { return flags & PAP_FLAG_ENABLED; }
+
+          // Seconds since epoch from which the next period can be charged.
+          uint32_t next_charge_at() const {
+            return begins_at.sec_since_epoch() + ((last_charged + 1) * REQUIRED_PERIOD_DURATION);
+          }
+
+          // Next due timestamp, so that a sweep over bydue from 0 to now() only visits rows
+          // that can be charged. Inactive rows sort after every timestamp: finished ones at
+          // PAP_DUE_INACTIVE, then blocked ones by the time they were disabled (see prune_paps).
+          uint64_t by_due() const {
+            if( last_charged >= periods )
+              return PAP_DUE_INACTIVE;
+            if( !enabled() )
+              return PAP_DUE_INACTIVE + disabled_at.sec_since_epoch();
+            return next_charge_at();
+          }
 
-        // Pre Authorized Payments
-        struct [[eosio::table]] pap {
+          static uint128_t _by_account_service(name account, uint32_t service_id) {
+            return (uint128_t{account.value}<<64) | (uint64_t)service_id;
+          }
+
+          static uint128_t _by_provider_service(name provider, uint32_t service_id) {
+            return (uint128_t{provider.value}<<64) | (uint64_t)service_id;
+          }
+        };
+
+        // PAP row layouts, oldest first (see versioned.hpp). Every layout is read through
+        // view( id, account, provider, service_id ), the columns kept out of the variant.
+        struct pap_v0 {
+          asset           price;
+          time_point_sec  begins_at;
+          uint16_t        periods;
+          uint16_t        last_charged;
+          uint8_t         flags;
+          time_point_sec  disabled_at;
+
+          static pap_v0 from( const pap& p ) {
+            return { p.price, p.begins_at, p.periods, p.last_charged, p.flags, p.disabled_at };
+          }
+          pap view( uint64_t id, const name& account, const name& provider, uint32_t service_id ) const {
+            return { id, account, provider, service_id, price, begins_at, periods, last_charged, flags, disabled_at };
+          }
+        };
+
+        // The columns the byprovserv and byaccserv keys are made of stay out of the variant,
+        // so that no layout change can move a row in those indexes.
+        struct [[eosio::table]] versioned_pap {
+          uint64_t                id;
+          name                    account;
+          name                    provider;
+          uint32_t                service_id;
+          std::variant<pap_v0>    data;
+
+          uint64_t primary_key() const { return id; }
+
+          pap view() const { return view_row( data, id, account, provider, service_id ); }
+
+          // Rows are written with the last layout whenever they are modified.
+          void set( const pap& p ) { data = pap_v0::from( p ); }
+
+          uint64_t by_due() const { return view().by_due(); }
+
+          uint128_t by_account_service() const {
+            return pap::_by_account_service(account, service_id);
+          }
+
+          uint128_t by_provider_service() const {
+            return pap::_by_provider_service(provider, service_id);
+          }
+        };
+
+        typedef profile::profiled_multi_index<
+          "paps"_n, versioned_pap,
+          indexed_by<"byprovserv"_n,  const_mem_fun<versioned_pap, uint128_t,   &versioned_pap::by_provider_service>>,
+          indexed_by<"byaccserv"_n,   const_mem_fun<versioned_pap, uint128_t,   &versioned_pap::by_account_service>>,
+          indexed_by<"bydue"_n,       const_mem_fun<versioned_pap, uint64_t,    &versioned_pap::by_due>>
+          >
+          paps;
+
+        // Resume point of an unfinished migratepaps walk over `paps`.
+        struct [[eosio::table]] papcursor {
+          uint64_t     next;
+        };
+
+        typedef profile::profiled_singleton<"papcursor"_n, papcursor> papcursors;
+
+        // Pre Authorized Payments, original layout. Kept only to migrate its rows to `paps`
+        // (see migratepaps and find_pap); no new rows are written here. Rows are never
+        // modified, only erased, which skips the bydue entries of rows that have none.
+        struct [[eosio::table]] legacy_pap {
           uint64_t        id;
           name            account;
           name            provider;
@@ -277,6 +746,19 @@ namespace eosio {
           // checksum256     account_service_provider;
 
           uint64_t primary_key() const { return id; }
+
+          // Seconds since epoch from which the next period can be charged.
+          uint32_t next_charge_at() const {
+            return begins_at.sec_since_epoch() + ((last_charged + 1) * REQUIRED_PERIOD_DURATION);
+          }
+
+          // Next due timestamp, or the maximum key for blocked and finished PAPs so that
+          // a sweep over bydue from 0 to now() only visits rows that can be charged.
+          uint64_t by_due() const {
+            if( enabled != STATE_ENABLED || last_charged >= periods )
+              return std::numeric_limits<uint64_t>::max();
+            return next_charge_at();
+          }
           
           uint128_t by_provider_account() const {
             return _by_provider_account(provider, account);
@@ -317,23 +799,96 @@ namespace eosio {
         };
 
 
-        typedef eosio::multi_index<
-          "pap"_n, pap,
-          indexed_by<"byall"_n,       const_mem_fun<pap, checksum256, &pap::by_account_service_provider>>,
-          indexed_by<"byprovserv"_n,  const_mem_fun<pap, uint128_t,   &pap::by_provider_service>>,
-          indexed_by<"byprovacc"_n,   const_mem_fun<pap, uint128_t,   &pap::by_provider_account>>,
-          indexed_by<"byaccserv"_n,   const_mem_fun<pap, uint128_t,   &pap::by_account_service>>
+        typedef profile::profiled_multi_index<
+          "pap"_n, legacy_pap,
+          indexed_by<"byall"_n,       const_mem_fun<legacy_pap, checksum256, &legacy_pap::by_account_service_provider>>,
+          indexed_by<"byprovserv"_n,  const_mem_fun<legacy_pap, uint128_t,   &legacy_pap::by_provider_service>>,
+          indexed_by<"byprovacc"_n,   const_mem_fun<legacy_pap, uint128_t,   &legacy_pap::by_provider_account>>,
+          indexed_by<"byaccserv"_n,   const_mem_fun<legacy_pap, uint128_t,   &legacy_pap::by_account_service>>,
+          indexed_by<"bydue"_n,       const_mem_fun<legacy_pap, uint64_t,    &legacy_pap::by_due>>
           >
-          paps;
+          legacy_paps;
 
-        struct [[eosio::table]] customer {
+        // A bank customer, as read from the `customers` table whatever the layout of its row.
+        struct customer {
           name         key;
           asset        fee;
           asset        overdraft;
-          uint32_t     account_type; 
+          uint32_t     account_type;
           uint32_t     state;
-          
+          uint8_t      flags;
+
+          // False once the customer opted out of notifications from bank initiated debits
+          // and credits (see setnotify).
+          bool notify() const { return !( flags & CUST_FLAG_NO_NOTIFY ); }
+        };
+
+        // Customer row layouts, oldest first (see versioned.hpp). Every layout is read through
+        // view( key, token ), `token` being the contract token (see config).
+        struct customer_v0 {
+          asset        fee;
+          asset        overdraft;
+          uint32_t     account_type;
+          uint32_t     state;
+
+          customer view( const name& key, const symbol& ) const {
+            return { key, fee, overdraft, account_type, state, 0 };
+          }
+        };
+
+        struct customer_v1 {
+          asset        fee;
+          asset        overdraft;
+          uint32_t     account_type;
+          uint32_t     state;
+          uint8_t      flags;
+
+          static customer_v1 from( const customer& c ) {
+            return { c.fee, c.overdraft, c.account_type, c.state, c.flags };
+          }
+          customer view( const name& key, const symbol& ) const {
+            return { key, fee, overdraft, account_type, state, flags };
+          }
+        };
+
+        // Packed layout: amounts of the contract token, account type in the low and state in
+        // the high nibble of `type_state`. 18 bytes instead of the 41 of customer_v1.
+        struct customer_v2 {
+          int64_t      fee;
+          int64_t      overdraft;
+          uint8_t      type_state;
+          uint8_t      flags;
+
+          static bool fits( const customer& c, const symbol& token ) {
+            return c.fee.symbol == token && c.overdraft.symbol == token
+                && c.account_type <= 0xf && c.state <= 0xf;
+          }
+          static customer_v2 from( const customer& c ) {
+            return { c.fee.amount, c.overdraft.amount, uint8_t( c.state << 4 | c.account_type ), c.flags };
+          }
+          customer view( const name& key, const symbol& token ) const {
+            return { key, asset( fee, token ), asset( overdraft, token ),
+                     uint32_t( type_state & 0xf ), uint32_t( type_state >> 4 ), flags };
+          }
+        };
+
+        struct [[eosio::table]] versioned_customer {
+          name                        key;
+          std::variant<customer_v0, customer_v1, customer_v2>   data;
+
           uint64_t primary_key() const { return key.value;}
+
+          customer view( const symbol& token ) const { return view_row( data, key, token ); }
+
+          // Customers with amounts of another token, or a type or state above 15, are kept in
+          // the previous layout.
+          void set( const customer& c, const symbol& token ) {
+            if( customer_v2::fits( c, token ) )
+              data = customer_v2::from( c );
+            else
+              data = customer_v1::from( c );
+          }
+          bool packed() const { return is_latest( data ); }
         };
 
         // typedef eosio::multi_index
@@ -348,8 +903,213 @@ namespace eosio {
         //       >
         //   > customers;
 
-        typedef eosio::multi_index<"customer"_n, customer> customers;
-        
+        typedef profile::profiled_multi_index<"customers"_n, versioned_customer> customers;
+
+        // Customers, original unversioned table. Kept only to migrate its rows to `customers`
+        // (see migratecusts and find_customer); no new rows are written here.
+        struct [[eosio::table]] legacy_customer {
+          name         key;
+          asset        fee;
+          asset        overdraft;
+          uint32_t     account_type;
+          uint32_t     state;
+
+          uint64_t primary_key() const { return key.value;}
+
+          customer view() const { return { key, fee, overdraft, account_type, state, 0 }; }
+        };
+
+        typedef profile::profiled_multi_index<"customer"_n, legacy_customer> legacy_customers;
+
+        // Resume point of an unfinished migratecusts walk over `customers`.
+        struct [[eosio::table]] custcursor {
+          name         next;
+        };
+
+        typedef profile::profiled_singleton<"custcursor"_n, custcursor> custcursors;
+
+        std::optional<customer> find_customer( const name& owner );
+        void store_customer( customer row, const symbol& token, bool keep_flags = false );
+        void upsert_customer( const customer_record& record, const symbol& token );
+        symbol customer_token();
+        static asset customer_fee( const std::optional<customer>& c, const symbol& sym );
+        static int64_t credit_limit( const std::optional<customer>& c, const symbol& sym );
+        void retire_overdraft( customer& row, const asset& issued );
+        static bool notified( const std::optional<customer>& c ) { return !c || c->notify(); }
+
+        // Customer fees charged and not settled yet, one row per token. Senders pay their fee
+        // in the same balance write as the transferred quantity; the bank admin balance is
+        // only credited by settlefees.
+        struct [[eosio::table]] feepool {
+          asset        accrued;
+
+          uint64_t primary_key() const { return accrued.symbol.code().raw(); }
+        };
+
+        typedef profile::profiled_multi_index<"feepool"_n, feepool> feepools;
+
+        // Resume point of an unfinished chargeall walk, scoped by provider.
+        struct [[eosio::table]] chargecursor {
+          uint32_t     service_id;
+          uint64_t     next_id;
+
+          uint64_t primary_key() const { return service_id; }
+        };
+
+        typedef profile::profiled_multi_index<"chargecursor"_n, chargecursor> chargecursors;
+
+        void prune_paps( const uint32_t& max_rows );
+        void move_charge_cursor( const versioned_pap& row );
+        charge_result charge_pap( const name&      from,
+                                  const name&      to,
+                                  const uint32_t&  service_id,
+                                  const asset&     quantity,
+                                  const uint32_t&  max_periods,
+                                  const string&    memo );
+
+      public:
+         // Row types of the contract tables, for off-chain readers (see native/tools/tabledump.cpp).
+         using account_row          = account;
+         using currency_stats_row   = currency_stats;
+         using config_row           = config;
+         using customer_row         = versioned_customer;
+         using legacy_customer_row  = legacy_customer;
+         using feepool_row          = feepool;
+         using pap_row              = versioned_pap;
+         using legacy_pap_row       = legacy_pap;
+
+         constexpr static   uint32_t     MAX_QUERY_ROWS             = 100;
+
+         /**
+          * Position in the PAPs of a provider or account: the service and id of the first row
+          * of a page. Rows are ordered by service, then id, so a page resumes at the same place
+          * when that row has been erased since.
+          */
+         struct pap_cursor {
+            uint32_t                  service_id;
+            uint64_t                  id;
+         };
+
+         /**
+          * Page of PAPs returned by `listprovpaps` and `listaccpaps`. `next` is the cursor of
+          * the following page, empty on the last one.
+          */
+         struct pap_page {
+            std::vector<pap>          rows;
+            std::optional<pap_cursor> next;
+         };
+
+         /**
+          * Page of customers returned by `listcusts`. `next` is the cursor of the following
+          * page, empty on the last one.
+          */
+         struct customer_page {
+            std::vector<customer>     rows;
+            std::optional<name>       next;
+         };
+
+         /**
+         * Query method returning the PAPs of @provider, ordered by service, one page of at most
+         * @limit rows (capped to MAX_QUERY_ROWS) starting at @cursor (the `next` of the previous
+         * page, empty for the first one). It writes nothing and needs no authority, so it is
+         * meant to be run as a read-only transaction and read through its return value.
+         * Fails until the legacy `pap` table has been emptied by migratepaps.
+         * @provider
+         * @cursor
+         * @limit
+         */
+         [[eosio::action]]
+         pap_page listprovpaps(const name&                        provider
+                             , const std::optional<pap_cursor>&  cursor
+                             , const uint32_t&                   limit);
+
+         /**
+         * Query method returning the PAPs of @account, ordered by service; paging as listprovpaps.
+         * @account
+         * @cursor
+         * @limit
+         */
+         [[eosio::action]]
+         pap_page listaccpaps(const name&                         account
+                            , const std::optional<pap_cursor>&   cursor
+                            , const uint32_t&                    limit);
+
+         /**
+         * Query method returning the customers from key @cursor on (inclusive), at most @limit
+         * rows (capped to MAX_QUERY_ROWS). Read only, as listprovpaps.
+         * @cursor
+         * @limit
+         */
+         [[eosio::action]]
+         customer_page listcusts(const name&       cursor
+                               , const uint32_t&   limit);
+
+         using listprovpaps_action  = eosio::action_wrapper<"listprovpaps"_n, &cristaltoken::listprovpaps>;
+         using listaccpaps_action   = eosio::action_wrapper<"listaccpaps"_n, &cristaltoken::listaccpaps>;
+         using listcusts_action     = eosio::action_wrapper<"listcusts"_n, &cristaltoken::listcusts>;
+
+      private:
+        template<typename Index>
+        pap_page page_paps( Index&                            idx,
+                            uint128_t (versioned_pap::*key_of)() const,
+                            const name&                       owner,
+                            const std::optional<pap_cursor>&  cursor,
+                            const uint32_t&                   limit );
+
+        paps::const_iterator find_pap( paps&            pap_list,
+                                       const name&      account,
+                                       const name&      provider,
+                                       const uint32_t&  service_id );
+        paps::const_iterator migrate_pap( paps& pap_list, legacy_paps& legacy_list, const legacy_pap& legacy );
+        uint64_t next_pap_id( const paps& pap_list );
+        bool paps_migrated();
+        void check_paps_migrated();
+
+        // Table handles opened by the running action. A contract object lives for one action,
+        // so every hot path (transfer_impl, sub_balance, add_balance, upsertpap, chargepap ...)
+        // shares one multi_index per table and scope: rows already loaded by the action are
+        // served from the multi_index object cache instead of new db_find/db_get calls.
+        class action_cache {
+          public:
+            action_cache( name self, name first_receiver )
+              : _self(self), _first_receiver(first_receiver) {}
+
+            configs&           config_table();
+            stats&             stats_of( const symbol_code& sym );
+            accounts&          accounts_of( const name& owner );
+            holders&           holders_of( const symbol_code& sym );
+            auditstates&       audits_of( const symbol_code& sym );
+            std::optional<auditstate>& audit_state( const symbol_code& sym );
+            customers&         customers_table();
+            legacy_customers&  legacy_customers_table();
+            feepools&          feepools_table();
+            paps&              paps_table();
+            legacy_paps&       legacy_paps_table();
+
+          private:
+            name                             _self;
+            name                             _first_receiver;
+            std::optional<configs>           _configs;
+            std::map<uint64_t, stats>        _stats;
+            std::map<uint64_t, accounts>     _accounts;
+            std::map<uint64_t, holders>      _holders;
+            std::map<uint64_t, auditstates>  _audits;
+            std::map<uint64_t, std::optional<auditstate>>  _audit_states;
+            std::optional<customers>         _customers;
+            std::optional<legacy_customers>  _legacy_customers;
+            std::optional<feepools>          _feepools;
+            std::optional<paps>              _paps;
+            std::optional<legacy_paps>       _legacy_paps;
+        };
+
+        profile::action_profile _profile;
+        action_cache _cache{ get_self(), get_first_receiver() };
+
+      public:
+         // Tables with secondary indexes, which native code has to open with their indexes
+         // (see native/tests/contract_tests.cpp).
+         using pap_table            = paps;
+         using legacy_pap_table     = legacy_paps;
 
    };
    /** @}*/ // end of @defgroup eosiotoken eosio.token
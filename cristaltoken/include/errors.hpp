@@ -0,0 +1,115 @@
+#pragma once
+
+#include <eosio/check.hpp>
+
+#include <cstdint>
+#ifndef CRISTALTOKEN_COMPACT_ERRORS
+#include <string>
+#endif
+
+namespace eosio {
+
+   /**
+    * @defgroup errors Error codes
+    *
+    * @details Every failure of the contract has a code and a message. Built with
+    * `-DCRISTALTOKEN_COMPACT_ERRORS=ON` a failure aborts with `check(false, code)`, which
+    * nodeos reports as "assertion failure with error code: <code>", and neither the
+    * messages nor any string formatting are compiled in. Otherwise the message is used.
+    *
+    * Codes above 2^32 carry a number in their low 32 bits: `code << 32 | value` (see
+    * `with_value`); ERR_PAP_NOT_DUE carries the whole days left until the PAP can be charged,
+    * e.g. 408021893149 = 95 << 32 | 29 means 29 days.
+    *
+    * Codes are part of the contract interface: add new ones, never renumber.
+    * @{
+    */
+   enum error_code : uint64_t {
+      // General
+      ERR_MEMO_TOO_LONG               = 1,    ///< memo has more than 256 bytes
+      ERR_MISSING_ADMIN_OR_PROVIDER   = 2,    ///< missing authority of the contract or the provider
+      ERR_MAX_ROWS_NOT_POSITIVE       = 3,    ///< max_rows must be positive
+      ERR_LIMIT_NOT_POSITIVE          = 4,    ///< limit must be positive
+      ERR_CURSOR_NOT_FOUND            = 5,    ///< no longer raised: PAP query cursors are positions
+      ERR_MISSING_ADMIN_OR_CUSTOMER   = 6,    ///< missing authority of the contract or the customer
+
+      // Token
+      ERR_INVALID_SYMBOL              = 20,   ///< invalid symbol name
+      ERR_SYMBOL_PRECISION_MISMATCH   = 21,   ///< symbol precision differs from the token's
+      ERR_INVALID_QUANTITY            = 22,   ///< invalid quantity
+      ERR_INVALID_SUPPLY              = 23,   ///< invalid maximum supply
+      ERR_MAX_SUPPLY_NOT_POSITIVE     = 24,   ///< maximum supply must be positive
+      ERR_TOKEN_EXISTS                = 25,   ///< token with symbol already exists
+      ERR_TOKEN_NOT_FOUND             = 26,   ///< token with symbol does not exist
+      ERR_ISSUE_NOT_POSITIVE          = 27,   ///< must issue positive quantity
+      ERR_SUPPLY_EXCEEDED             = 28,   ///< quantity exceeds available supply
+      ERR_RETIRE_NOT_POSITIVE         = 29,   ///< must retire positive quantity
+      ERR_TRANSFER_NOT_POSITIVE       = 30,   ///< must transfer positive quantity
+      ERR_TRANSFER_TO_SELF            = 31,   ///< cannot transfer to self
+      ERR_TO_ACCOUNT_NOT_FOUND        = 32,   ///< to account does not exist
+      ERR_OWNER_ACCOUNT_NOT_FOUND     = 33,   ///< owner account does not exist
+      ERR_OVERDRAWN_BALANCE           = 34,   ///< overdrawn balance
+      ERR_BALANCE_NOT_FOUND           = 35,   ///< no balance row for the token
+      ERR_BALANCE_NOT_ZERO            = 36,   ///< cannot close a non zero balance
+      ERR_NO_PAYOUTS                  = 37,   ///< no payouts to transfer
+      ERR_CONTRACT_TOKEN_NOT_SET      = 38,   ///< contract token not set (see setconfig)
+      ERR_NO_FEES_TO_SETTLE           = 39,   ///< no fees to settle
+      ERR_CONTRACT_TOKEN_SET          = 40,   ///< contract token already set to another symbol
+
+      // Customers
+      ERR_CUSTOMER_NOT_FOUND          = 60,   ///< customer account does not exist
+      ERR_CUSTOMER_NOT_ENABLED        = 61,   ///< customer account is not enabled
+      ERR_PROVIDER_NOT_FOUND          = 62,   ///< provider account does not exist
+      ERR_PROVIDER_NOT_ENABLED        = 63,   ///< provider account is not enabled
+      ERR_PROVIDER_TYPE               = 64,   ///< provider is neither a business nor an admin
+      ERR_NOT_ADMIN                   = 65,   ///< account is not a bank admin
+      ERR_INVALID_OVERDRAFT           = 66,   ///< overdraft is invalid or negative
+      ERR_NO_CUSTOMERS                = 67,   ///< no customers to upsert
+      ERR_NO_OVERDRAFTS               = 68,   ///< no issued overdrafts to retire
+      ERR_OVERDRAFT_RETIRED           = 69,   ///< overdraft already a credit line
+
+      // Pre Authorized Payments
+      ERR_PAP_NOT_FOUND               = 80,   ///< PAP (account, provider, service) not found
+      ERR_PAP_NOT_ENABLED             = 81,   ///< PAP is not enabled
+      ERR_PAP_SAME_ACCOUNTS           = 82,   ///< customer and provider are the same account
+      ERR_PAP_PERIODS_NOT_POSITIVE    = 83,   ///< periods is less than 1
+      ERR_PAP_PERIODS_TOO_LARGE       = 84,   ///< periods does not fit in 16 bits
+      ERR_PAP_INVALID_PRICE_SYMBOL    = 85,   ///< invalid price symbol name
+      ERR_PAP_PRICE_TOKEN_NOT_FOUND   = 86,   ///< price token does not exist
+      ERR_PAP_INVALID_PRICE           = 87,   ///< invalid price quantity
+      ERR_PAP_PRICE_NOT_POSITIVE      = 88,   ///< price must be positive
+      ERR_PAP_PRICE_PRECISION         = 89,   ///< price symbol precision mismatch
+      ERR_PAP_INVALID_ENABLED         = 90,   ///< enabled is neither STATE_ENABLED nor STATE_BLOCKED
+      ERR_PAP_SYMBOL_MISMATCH         = 91,   ///< quantity symbol differs from the price's
+      ERR_PAP_PRICE_MISMATCH          = 92,   ///< quantity differs from the agreed price
+      ERR_PAP_ENDED                   = 93,   ///< every period was already charged
+      ERR_PAP_MAX_PERIODS             = 94,   ///< max_periods must be positive
+      ERR_PAP_NOT_DUE                 = 95,   ///< next period not due yet; value: days left
+      ERR_PAPS_NOT_MIGRATED           = 96,   ///< legacy PAPs left, run migratepaps first
+   };
+
+   constexpr uint64_t with_value( error_code code, uint32_t value ) {
+      return ( uint64_t(code) << 32 ) | value;
+   }
+
+   inline void check( bool pred, error_code code, const char* msg ) {
+#ifdef CRISTALTOKEN_COMPACT_ERRORS
+      if( !pred ) check( false, uint64_t(code) );
+#else
+      if( !pred ) check( false, msg );
+#endif
+   }
+
+   /**
+    * Fails with `code` carrying `value`; the message is `before` value `after`.
+    */
+   inline void check( bool pred, error_code code, uint32_t value, const char* before, const char* after ) {
+#ifdef CRISTALTOKEN_COMPACT_ERRORS
+      if( !pred ) check( false, with_value( code, value ) );
+#else
+      if( !pred ) check( false, before + std::to_string( value ) + after );
+#endif
+   }
+
+   /** @}*/ // end of @defgroup errors
+} /// namespace eosio
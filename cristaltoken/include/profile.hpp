@@ -0,0 +1,276 @@
+#pragma once
+
+#include <eosio/eosio.hpp>
+#include <eosio/singleton.hpp>
+
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+namespace eosio {
+
+   /**
+    * @defgroup profile Table profiling
+    *
+    * @details Instrumentation compiled in with `-DCRISTALTOKEN_PROFILE=ON`.
+    * `profiled_multi_index` is a drop-in for eosio::multi_index that counts the table
+    * operations reaching the db_* host functions and estimates the RAM billed for the
+    * rows and secondary index entries it writes; `profiled_singleton` does the same for
+    * eosio::singleton, whose calls are one row lookup each. `action_profile` resets the counters
+    * when an action starts and prints them to the console when it ends:
+    *
+    *    profile: find=4 store=1 update=2 remove=0 idx_find=1 idx_store=3 idx_update=1 idx_remove=0 ram=+325
+    *
+    * Calls are counted at the multi_index interface, so a lookup answered from the
+    * multi_index object cache still counts as a find, and iterator steps are not counted.
+    * RAM uses the nodeos billable sizes: 108 bytes per row plus its packed size, and
+    * 120 bytes plus the key per secondary index entry; scope (table_id) rows are ignored.
+    * Without the option the table names are plain aliases and nothing is counted.
+    * @{
+    */
+   namespace profile {
+
+#ifdef CRISTALTOKEN_PROFILE
+
+      struct counters {
+         uint32_t  find;
+         uint32_t  store;
+         uint32_t  update;
+         uint32_t  remove;
+         uint32_t  idx_find;
+         uint32_t  idx_store;
+         uint32_t  idx_update;
+         uint32_t  idx_remove;
+         int64_t   ram;
+      };
+
+      inline counters& current() {
+         static counters c{};
+         return c;
+      }
+
+      constexpr int64_t row_overhead_bytes   = 108;   // config::billable_size_v<key_value_object>
+      constexpr int64_t index_overhead_bytes = 120;   // config::billable_size_v<index64_object> minus its key
+
+      template<typename Index, typename Table>
+      class profiled_index : public Index {
+         public:
+            using typename Index::const_iterator;
+
+            profiled_index( const Index& idx, Table& table ) : Index(idx), _table(table) {}
+
+            template<typename Key>
+            const_iterator find( const Key& key )const {
+               ++current().idx_find;
+               return Index::find( key );
+            }
+
+            template<typename Key>
+            const_iterator lower_bound( const Key& key )const {
+               ++current().idx_find;
+               return Index::lower_bound( key );
+            }
+
+            template<typename Key>
+            const_iterator upper_bound( const Key& key )const {
+               ++current().idx_find;
+               return Index::upper_bound( key );
+            }
+
+            template<typename Row>
+            const_iterator iterator_to( const Row& obj )const {
+               ++current().idx_find;
+               return Index::iterator_to( obj );
+            }
+
+            template<typename Lambda>
+            void modify( const_iterator itr, name payer, Lambda&& updater ) {
+               check( itr != this->cend(), "cannot pass end iterator to modify" );
+               _table.modify( *itr, payer, std::forward<Lambda>(updater) );
+            }
+
+            const_iterator erase( const_iterator itr ) {
+               check( itr != this->cend(), "cannot pass end iterator to erase" );
+               const auto& obj = *itr;
+               ++itr;
+               _table.erase( obj );
+               return itr;
+            }
+
+         private:
+            Table& _table;
+      };
+
+      template<name::raw TableName, typename T, typename... Indices>
+      class profiled_multi_index : public eosio::multi_index<TableName, T, Indices...> {
+         using base = eosio::multi_index<TableName, T, Indices...>;
+
+         public:
+            using typename base::const_iterator;
+            using base::base;
+
+            const_iterator find( uint64_t primary )const {
+               ++current().find;
+               return base::find( primary );
+            }
+
+            const_iterator require_find( uint64_t primary, const char* error_msg = "unable to find key" )const {
+               ++current().find;
+               return base::require_find( primary, error_msg );
+            }
+
+            const T& get( uint64_t primary, const char* error_msg = "unable to find key" )const {
+               ++current().find;
+               return base::get( primary, error_msg );
+            }
+
+            const_iterator lower_bound( uint64_t primary )const {
+               ++current().find;
+               return base::lower_bound( primary );
+            }
+
+            const_iterator upper_bound( uint64_t primary )const {
+               ++current().find;
+               return base::upper_bound( primary );
+            }
+
+            template<name::raw IndexName>
+            auto get_index() {
+               using index_type = decltype( base::template get_index<IndexName>() );
+               return profiled_index<index_type, profiled_multi_index>( base::template get_index<IndexName>(), *this );
+            }
+
+            template<typename Lambda>
+            const_iterator emplace( name payer, Lambda&& constructor ) {
+               auto& c = current();
+               auto itr = base::emplace( payer, std::forward<Lambda>(constructor) );
+               ++c.store;
+               c.idx_store += sizeof...(Indices);
+               c.ram += row_bytes( *itr );
+               return itr;
+            }
+
+            template<typename Lambda>
+            void modify( const_iterator itr, name payer, Lambda&& updater ) {
+               check( itr != this->cend(), "cannot pass end iterator to modify" );
+               modify( *itr, payer, std::forward<Lambda>(updater) );
+            }
+
+            template<typename Lambda>
+            void modify( const T& obj, name payer, Lambda&& updater ) {
+               auto& c = current();
+               int64_t size = pack_size( obj );
+               auto keys = secondary_keys( obj );
+               base::modify( obj, payer, std::forward<Lambda>(updater) );
+               ++c.update;
+               c.idx_update += changed_keys( keys, secondary_keys( obj ), std::index_sequence_for<Indices...>{} );
+               c.ram += int64_t( pack_size( obj ) ) - size;
+            }
+
+            const_iterator erase( const_iterator itr ) {
+               check( itr != this->cend(), "cannot pass end iterator to erase" );
+               const auto& obj = *itr;
+               ++itr;
+               erase( obj );
+               return itr;
+            }
+
+            void erase( const T& obj ) {
+               auto& c = current();
+               c.ram -= row_bytes( obj );
+               base::erase( obj );
+               ++c.remove;
+               c.idx_remove += sizeof...(Indices);
+            }
+
+         private:
+            static auto secondary_keys( const T& obj ) {
+               return std::make_tuple( typename Indices::secondary_extractor_type()( obj )... );
+            }
+
+            template<typename Keys, std::size_t... I>
+            static uint32_t changed_keys( const Keys& before, const Keys& after, std::index_sequence<I...> ) {
+               return ( 0 + ... + uint32_t( std::get<I>(before) != std::get<I>(after) ) );
+            }
+
+            static int64_t row_bytes( const T& obj ) {
+               return row_overhead_bytes + int64_t( pack_size( obj ) )
+                    + ( 0 + ... + ( index_overhead_bytes + int64_t( sizeof( typename Indices::secondary_extractor_type::result_type ) ) ) );
+            }
+      };
+
+      template<name::raw SingletonName, typename T>
+      class profiled_singleton : public eosio::singleton<SingletonName, T> {
+         using base = eosio::singleton<SingletonName, T>;
+
+         public:
+            using base::base;
+
+            bool exists()const {
+               ++current().find;
+               return base::exists();
+            }
+
+            T get()const {
+               ++current().find;
+               return base::get();
+            }
+
+            T get_or_default( const T& def = T() )const {
+               ++current().find;
+               return base::get_or_default( def );
+            }
+
+            // One find, then an update or a store of the row, as eosio::singleton::set.
+            void set( const T& value, name bill_to_account ) {
+               auto& c = current();
+               ++c.find;
+               if( base::exists() ) {
+                  ++c.update;
+                  c.ram += int64_t( pack_size( value ) ) - int64_t( pack_size( base::get() ) );
+               }
+               else {
+                  ++c.store;
+                  c.ram += row_overhead_bytes + int64_t( pack_size( value ) );
+               }
+               base::set( value, bill_to_account );
+            }
+
+            void remove() {
+               auto& c = current();
+               ++c.find;
+               if( base::exists() ) {
+                  ++c.remove;
+                  c.ram -= row_overhead_bytes + int64_t( pack_size( base::get() ) );
+               }
+               base::remove();
+            }
+      };
+
+      class action_profile {
+         public:
+            action_profile() { current() = counters{}; }
+
+            ~action_profile() {
+               const auto& c = current();
+               print( "profile: find=", c.find, " store=", c.store, " update=", c.update, " remove=", c.remove,
+                      " idx_find=", c.idx_find, " idx_store=", c.idx_store, " idx_update=", c.idx_update,
+                      " idx_remove=", c.idx_remove, " ram=", c.ram >= 0 ? "+" : "", c.ram, "\n" );
+            }
+      };
+
+#else
+
+      template<name::raw TableName, typename T, typename... Indices>
+      using profiled_multi_index = eosio::multi_index<TableName, T, Indices...>;
+
+      template<name::raw SingletonName, typename T>
+      using profiled_singleton = eosio::singleton<SingletonName, T>;
+
+      struct action_profile {};
+
+#endif
+
+   } /// namespace profile
+   /** @}*/ // end of @defgroup profile
+} /// namespace eosio
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <variant>
+
+namespace eosio {
+
+   /**
+    * @defgroup versioned Versioned rows
+    *
+    * @details A versioned table stores every row as `std::variant<Layout0, ..., LayoutN>`,
+    * oldest layout first. The packed row starts with the index of its layout, so rows of
+    * different layouts live side by side in one table and a layout change needs neither a
+    * new table nor a one-shot migration of every row.
+    *
+    * Contract code never deals with the layouts themselves: every layout converts to one
+    * view type with `view(...)`, called through `view_row` whatever the layout of the row,
+    * and rows are written with the last layout that can hold the value. Rows are thus
+    * migrated when they are written; cold rows are moved by a bounded migration action
+    * (see `migratecusts`).
+    *
+    * Adding a layout: append it to the variant and give it `view(...)`, with the same
+    * parameters as the other layouts. Layouts are never removed nor reordered, since the
+    * index of a layout is part of the stored rows.
+    * @{
+    */
+   template<typename... Layouts>
+   constexpr bool is_latest( const std::variant<Layouts...>& row ) {
+      return row.index() == sizeof...(Layouts) - 1;
+   }
+
+   template<typename... Layouts, typename... Args>
+   auto view_row( const std::variant<Layouts...>& row, const Args&... args ) {
+      return std::visit( [&]( const auto& layout ) { return layout.view( args... ); }, row );
+   }
+
+   /** @}*/ // end of @defgroup versioned
+} /// namespace eosio
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <eosio/datastream.hpp>
+#include <eosio/name.hpp>
+#include <eosio/native/runtime.hpp>
+
+#include <any>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace eosio {
+
+   struct permission_level {
+      permission_level( name a, name p ) : actor(a), permission(p) {}
+      permission_level() {}
+
+      name actor;
+      name permission;
+
+      friend bool operator==( const permission_level& a, const permission_level& b ) {
+         return a.actor == b.actor && a.permission == b.permission;
+      }
+   };
+
+   void require_auth( name n );
+   bool has_auth( name n );
+   bool is_account( name n );
+   void require_recipient( name notify_account );
+   /// Account that sent the running inline action, empty for the actions of the transaction.
+   name get_sender();
+
+   inline void require_auth( const permission_level& level ) { require_auth( level.actor ); }
+
+   template<typename... accounts>
+   void require_recipient( name notify_account, accounts... remaining_accounts ) {
+      require_recipient( notify_account );
+      require_recipient( remaining_accounts... );
+   }
+
+   namespace native {
+
+      template<auto Action>
+      struct action_traits;
+
+      template<typename C, typename R, typename... Args, R (C::*Action)(Args...)>
+      struct action_traits<Action> {
+         using contract_type = C;
+         using return_type   = R;
+         using args_tuple    = std::tuple<std::decay_t<Args>...>;
+      };
+
+      /**
+       * Dispatches `Action` natively: a fresh contract object is constructed for the
+       * receiver, exactly like the generated WASM dispatcher does for every action.
+       */
+      template<auto Action>
+      void send_action( name code, name act, const std::vector<permission_level>& perms,
+                        typename action_traits<Action>::args_tuple args ) {
+         using traits = action_traits<Action>;
+         std::vector<name> actors;
+         actors.reserve( perms.size() );
+         for( const auto& p : perms ) actors.push_back( p.actor );
+
+         dispatch( code, act, std::move(actors), [code, args = std::move(args)]() -> std::any {
+            typename traits::contract_type c( code, code, datastream<const char*>(nullptr, 0) );
+            if constexpr( std::is_void_v<typename traits::return_type> ) {
+               std::apply( [&]( const auto&... a ) { (c.*Action)( a... ); }, args );
+               return {};
+            } else {
+               return std::any( std::apply( [&]( const auto&... a ) { return (c.*Action)( a... ); }, args ) );
+            }
+         });
+      }
+
+      template<auto Action>
+      struct inline_dispatcher {
+         static void call( name code, name act, std::vector<permission_level> perms,
+                           typename action_traits<Action>::args_tuple args ) {
+            send_action<Action>( code, act, perms, std::move(args) );
+         }
+      };
+
+   } /// namespace native
+
+   /**
+    * Native stand-in for eosio::action_wrapper; `send` runs the action natively.
+    */
+   template<name::raw Name, auto Action>
+   struct action_wrapper {
+      static constexpr name action_name = name(Name);
+
+      action_wrapper( name code, std::vector<permission_level> perms )
+         : code_name(code), permissions(std::move(perms)) {}
+      action_wrapper( name code, const permission_level& perm )
+         : code_name(code), permissions({perm}) {}
+      action_wrapper( name code, name actor )
+         : code_name(code), permissions({permission_level(actor, name("active"))}) {}
+
+      template<typename... Args>
+      void send( Args&&... args )const {
+         native::send_action<Action>( code_name, action_name, permissions,
+                                      typename native::action_traits<Action>::args_tuple( std::forward<Args>(args)... ) );
+      }
+
+      name                          code_name;
+      std::vector<permission_level> permissions;
+   };
+
+} /// namespace eosio
+
+#define SEND_INLINE_ACTION( CONTRACT, NAME, ... ) \
+   ::eosio::native::inline_dispatcher<&std::decay_t<decltype(CONTRACT)>::NAME>::call( (CONTRACT).get_self(), ::eosio::name(#NAME), __VA_ARGS__ )
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <eosio/check.hpp>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace eosio {
+
+   /**
+    * Native stand-in for eosio::symbol_code, same encoding as the CDT type.
+    */
+   class symbol_code {
+      public:
+         constexpr symbol_code() : value(0) {}
+         constexpr explicit symbol_code( uint64_t raw ) : value(raw) {}
+         constexpr explicit symbol_code( std::string_view str ) : value(0) {
+            if( str.size() > 7 ) check( false, "string is too long to be a valid symbol_code" );
+            for( auto itr = str.rbegin(); itr != str.rend(); ++itr ) {
+               if( *itr < 'A' || *itr > 'Z' ) check( false, "only uppercase letters allowed in symbol_code string" );
+               value <<= 8;
+               value |= *itr;
+            }
+         }
+
+         constexpr bool is_valid()const {
+            auto sym = value;
+            for( int i = 0; i < 7; i++ ) {
+               char c = (char)(sym & 0xFF);
+               if( !('A' <= c && c <= 'Z') ) return false;
+               sym >>= 8;
+               if( !(sym & 0xFF) ) {
+                  do {
+                     sym >>= 8;
+                     if( (sym & 0xFF) ) return false;
+                     i++;
+                  } while( i < 7 );
+               }
+            }
+            return true;
+         }
+
+         constexpr uint64_t raw()const { return value; }
+         constexpr explicit operator bool()const { return value != 0; }
+
+         std::string to_string()const {
+            std::string s;
+            auto v = value;
+            while( v > 0 ) { s += char(v & 0xFF); v >>= 8; }
+            return s;
+         }
+
+         char* write_as_string( char* begin, char* end, bool dry_run = false )const {
+            for( auto v = value; v > 0; v >>= 8, ++begin ) {
+               if( !dry_run && begin < end ) *begin = char(v & 0xFF);
+            }
+            return begin;
+         }
+
+         friend constexpr bool operator==( const symbol_code& a, const symbol_code& b ) { return a.value == b.value; }
+         friend constexpr bool operator!=( const symbol_code& a, const symbol_code& b ) { return a.value != b.value; }
+         friend constexpr bool operator< ( const symbol_code& a, const symbol_code& b ) { return a.value <  b.value; }
+
+      private:
+         uint64_t value = 0;
+   };
+
+   /**
+    * Native stand-in for eosio::symbol (code plus precision).
+    */
+   class symbol {
+      public:
+         constexpr symbol() : value(0) {}
+         constexpr explicit symbol( uint64_t raw ) : value(raw) {}
+         constexpr symbol( symbol_code sc, uint8_t precision ) : value( (sc.raw() << 8) | (uint64_t)precision ) {}
+         constexpr symbol( std::string_view ss, uint8_t precision ) : value( (symbol_code(ss).raw() << 8) | (uint64_t)precision ) {}
+
+         constexpr bool        is_valid()const  { return code().is_valid(); }
+         constexpr uint8_t     precision()const { return value & 0xFFull; }
+         constexpr symbol_code code()const      { return symbol_code{value >> 8}; }
+         constexpr uint64_t    raw()const       { return value; }
+         constexpr explicit operator bool()const { return value != 0; }
+
+         std::string to_string()const { return std::to_string(precision()) + "," + code().to_string(); }
+
+         friend constexpr bool operator==( const symbol& a, const symbol& b ) { return a.value == b.value; }
+         friend constexpr bool operator!=( const symbol& a, const symbol& b ) { return a.value != b.value; }
+         friend constexpr bool operator< ( const symbol& a, const symbol& b ) { return a.value <  b.value; }
+
+      private:
+         uint64_t value = 0;
+   };
+
+   /**
+    * Native stand-in for eosio::asset with the same range and symbol checks.
+    */
+   struct asset {
+      int64_t amount = 0;
+      eosio::symbol symbol;
+
+      static constexpr int64_t max_amount = (1LL << 62) - 1;
+
+      asset() {}
+      asset( int64_t a, eosio::symbol s ) : amount(a), symbol(s) {
+         check( is_amount_within_range(), "magnitude of asset amount must be less than 2^62" );
+         check( symbol.is_valid(),        "invalid symbol name" );
+      }
+
+      bool is_amount_within_range()const { return -max_amount <= amount && amount <= max_amount; }
+      bool is_valid()const               { return is_amount_within_range() && symbol.is_valid(); }
+
+      void set_amount( int64_t a ) {
+         amount = a;
+         check( is_amount_within_range(), "magnitude of asset amount must be less than 2^62" );
+      }
+
+      asset operator-()const { return asset( -amount, symbol ); }
+
+      asset& operator-=( const asset& a ) {
+         check( a.symbol == symbol, "attempt to subtract asset with different symbol" );
+         amount -= a.amount;
+         check( -max_amount <= amount, "subtraction underflow" );
+         check( amount <= max_amount,  "subtraction overflow" );
+         return *this;
+      }
+
+      asset& operator+=( const asset& a ) {
+         check( a.symbol == symbol, "attempt to add asset with different symbol" );
+         amount += a.amount;
+         check( -max_amount <= amount, "addition underflow" );
+         check( amount <= max_amount,  "addition overflow" );
+         return *this;
+      }
+
+      friend asset operator+( const asset& a, const asset& b ) { asset r = a; r += b; return r; }
+      friend asset operator-( const asset& a, const asset& b ) { asset r = a; r -= b; return r; }
+
+      asset& operator*=( int64_t a ) {
+         __int128 tmp = (__int128)amount * (__int128)a;
+         check( tmp <= max_amount,  "multiplication overflow" );
+         check( tmp >= -max_amount, "multiplication underflow" );
+         amount = (int64_t)tmp;
+         return *this;
+      }
+
+      friend asset operator*( const asset& a, int64_t b ) { asset r = a; r *= b; return r; }
+      friend asset operator*( int64_t b, const asset& a ) { asset r = a; r *= b; return r; }
+
+      friend bool operator==( const asset& a, const asset& b ) {
+         check( a.symbol == b.symbol, "comparison of assets with different symbols is not allowed" );
+         return a.amount == b.amount;
+      }
+      friend bool operator!=( const asset& a, const asset& b ) { return !( a == b ); }
+      friend bool operator<( const asset& a, const asset& b ) {
+         check( a.symbol == b.symbol, "comparison of assets with different symbols is not allowed" );
+         return a.amount < b.amount;
+      }
+      friend bool operator<=( const asset& a, const asset& b ) { return !( b < a ); }
+      friend bool operator> ( const asset& a, const asset& b ) { return b < a; }
+      friend bool operator>=( const asset& a, const asset& b ) { return !( a < b ); }
+
+      /**
+       * Writes the asset as `to_string` does to [begin, end) without allocating; returns the
+       * end of what was (or, with `dry_run`, would be) written. Nothing is written past `end`.
+       */
+      char* write_as_string( char* begin, char* end, bool dry_run = false )const {
+         bool negative = amount < 0;
+         uint64_t abs_amount = negative ? -(uint64_t)amount : (uint64_t)amount;
+         char digits[24];
+         int n = 0;
+         do { digits[n++] = char('0' + abs_amount % 10); abs_amount /= 10; } while( abs_amount );
+         auto p = symbol.precision();
+         while( n <= p && n < int(sizeof(digits)) ) digits[n++] = '0';
+         auto put = [&]( char c ) { if( !dry_run && begin < end ) *begin = c; ++begin; };
+         if( negative ) put( '-' );
+         for( int i = n - 1; i >= 0; --i ) {
+            put( digits[i] );
+            if( i == p && p > 0 ) put( '.' );
+         }
+         put( ' ' );
+         return symbol.code().write_as_string( begin, end, dry_run );
+      }
+
+      std::string to_string()const {
+         bool negative = amount < 0;
+         uint64_t abs_amount = negative ? -(uint64_t)amount : (uint64_t)amount;
+         std::string digits = std::to_string( abs_amount );
+         auto p = symbol.precision();
+         if( p > 0 ) {
+            if( digits.size() <= p ) digits.insert( 0, p + 1 - digits.size(), '0' );
+            digits.insert( digits.size() - p, "." );
+         }
+         return (negative ? "-" : "") + digits + " " + symbol.code().to_string();
+      }
+   };
+
+} /// namespace eosio
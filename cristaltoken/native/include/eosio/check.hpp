@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace eosio {
+
+   namespace native {
+      /**
+       * Thrown by `check` when an assertion fails; the native chain turns it into
+       * a rolled back action exactly like `eosio_assert` does on chain.
+       */
+      struct assertion_failure : std::runtime_error {
+         explicit assertion_failure( const std::string& msg, uint64_t c = 0 )
+            : std::runtime_error(msg), code(c) {}
+         uint64_t code;
+      };
+   }
+
+   inline void check( bool pred, std::string_view msg ) {
+      if( !pred ) throw native::assertion_failure( std::string(msg) );
+   }
+
+   inline void check( bool pred, const char* msg ) {
+      if( !pred ) throw native::assertion_failure( msg );
+   }
+
+   inline void check( bool pred, const std::string& msg ) {
+      if( !pred ) throw native::assertion_failure( msg );
+   }
+
+   inline void check( bool pred, uint64_t code ) {
+      if( !pred ) throw native::assertion_failure( "assertion failure with error code: " + std::to_string(code), code );
+   }
+
+} /// namespace eosio
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <eosio/asset.hpp>
+#include <eosio/check.hpp>
+#include <eosio/fixed_bytes.hpp>
+#include <eosio/name.hpp>
+#include <eosio/native/reflect.hpp>
+#include <eosio/time.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace eosio {
+
+   /**
+    * Minimal stand-in for eosio::datastream: enough to construct a contract natively and
+    * to unpack rows read off chain (see `operator>>` below).
+    */
+   template<typename T>
+   class datastream {
+      public:
+         datastream( T start, std::size_t s ) : _start(start), _pos(start), _end(start + s) {}
+
+         T pos()const { return _pos; }
+         std::size_t remaining()const { return _end - _pos; }
+
+         bool skip( std::size_t s ) {
+            check( s <= remaining(), "datastream attempted to read past the end" );
+            _pos += s;
+            return true;
+         }
+
+         bool read( char* d, std::size_t s ) {
+            check( s <= remaining(), "datastream attempted to read past the end" );
+            std::memcpy( d, _pos, s );
+            _pos += s;
+            return true;
+         }
+
+      private:
+         T _start;
+         T _pos;
+         T _end;
+   };
+
+   namespace native {
+      inline std::size_t varuint32_size( uint64_t v ) {
+         std::size_t n = 0;
+         do { v >>= 7; ++n; } while( v );
+         return n;
+      }
+
+      template<typename Stream>
+      uint32_t read_varuint32( datastream<Stream>& ds ) {
+         uint64_t v = 0;
+         char     b = 0;
+         uint8_t  by = 0;
+         do {
+            ds.read( &b, 1 );
+            v |= uint64_t( uint8_t(b) & 0x7f ) << by;
+            by += 7;
+         } while( uint8_t(b) & 0x80 && by < 32 );
+         return static_cast<uint32_t>( v );
+      }
+   }
+
+   /**
+    * Size of `v` in the chain's binary serialization, i.e. the bytes a row occupies
+    * in a table. Aggregates are sized field by field like the CDT serializer does.
+    */
+   template<typename T>
+   std::size_t pack_size( const T& v );
+
+   inline std::size_t pack_size( const std::string& s ) { return native::varuint32_size( s.size() ) + s.size(); }
+
+   template<typename T>
+   std::size_t pack_size( const std::vector<T>& v ) {
+      std::size_t n = native::varuint32_size( v.size() );
+      for( const auto& e : v ) n += pack_size( e );
+      return n;
+   }
+
+   template<typename T>
+   std::size_t pack_size( const std::optional<T>& v ) { return 1 + ( v ? pack_size( *v ) : 0 ); }
+
+   template<typename... Ts>
+   std::size_t pack_size( const std::variant<Ts...>& v ) {
+      return native::varuint32_size( v.index() ) + std::visit( []( const auto& a ) { return pack_size( a ); }, v );
+   }
+
+   template<typename T>
+   std::size_t pack_size( const T& v ) {
+      if constexpr( std::is_arithmetic_v<T> || std::is_enum_v<T> )
+         return sizeof(T);
+      else if constexpr( std::is_same_v<T, unsigned __int128> || std::is_same_v<T, __int128> )
+         return 16;
+      else if constexpr( std::is_same_v<T, name> || std::is_same_v<T, symbol> || std::is_same_v<T, symbol_code> )
+         return 8;
+      else if constexpr( std::is_same_v<T, asset> )
+         return 16;
+      else if constexpr( std::is_same_v<T, time_point_sec> )
+         return 4;
+      else if constexpr( std::is_same_v<T, time_point> )
+         return 8;
+      else if constexpr( std::is_same_v<T, checksum256> )
+         return 32;
+      else {
+         std::size_t n = 0;
+         native::for_each_field( v, [&]( const auto& field ) { n += pack_size( field ); } );
+         return n;
+      }
+   }
+
+   /**
+    * Unpacks `v` from the chain's binary serialization. Aggregates are read field by field
+    * in declaration order, like the CDT serializer generated for a table struct.
+    */
+   template<typename Stream, typename T>
+   datastream<Stream>& operator>>( datastream<Stream>& ds, T& v );
+
+   template<typename Stream>
+   datastream<Stream>& operator>>( datastream<Stream>& ds, std::string& s ) {
+      auto size = native::read_varuint32( ds );
+      s.resize( size );
+      if( size ) ds.read( s.data(), size );
+      return ds;
+   }
+
+   template<typename Stream, typename T>
+   datastream<Stream>& operator>>( datastream<Stream>& ds, std::vector<T>& v ) {
+      v.resize( native::read_varuint32( ds ) );
+      for( auto& e : v ) ds >> e;
+      return ds;
+   }
+
+   template<typename Stream, typename T>
+   datastream<Stream>& operator>>( datastream<Stream>& ds, std::optional<T>& v ) {
+      bool has = false;
+      ds >> has;
+      if( has ) { T e{}; ds >> e; v = std::move( e ); }
+      else v.reset();
+      return ds;
+   }
+
+   template<typename Stream, typename... Ts>
+   datastream<Stream>& operator>>( datastream<Stream>& ds, std::variant<Ts...>& v ) {
+      auto index = native::read_varuint32( ds );
+      check( index < sizeof...(Ts), "invalid variant index" );
+      [&]<std::size_t... I>( std::index_sequence<I...> ) {
+         ( ( index == I ? ( ds >> v.template emplace<I>(), true ) : false ) || ... );
+      }( std::index_sequence_for<Ts...>{} );
+      return ds;
+   }
+
+   template<typename Stream, typename T>
+   datastream<Stream>& operator>>( datastream<Stream>& ds, T& v ) {
+      if constexpr( std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_same_v<T, unsigned __int128> || std::is_same_v<T, __int128> ) {
+         ds.read( reinterpret_cast<char*>( &v ), sizeof(T) );
+      } else if constexpr( std::is_same_v<T, name> ) {
+         ds >> v.value;
+      } else if constexpr( std::is_same_v<T, symbol> ) {
+         uint64_t raw = 0; ds >> raw; v = symbol( raw );
+      } else if constexpr( std::is_same_v<T, symbol_code> ) {
+         uint64_t raw = 0; ds >> raw; v = symbol_code( raw );
+      } else if constexpr( std::is_same_v<T, asset> ) {
+         ds >> v.amount >> v.symbol;
+      } else if constexpr( std::is_same_v<T, time_point_sec> ) {
+         ds >> v.utc_seconds;
+      } else if constexpr( std::is_same_v<T, time_point> ) {
+         ds >> v.elapsed._count;
+      } else {
+         native::for_each_field( v, [&]( auto& field ) { ds >> field; } );
+      }
+      return ds;
+   }
+
+} /// namespace eosio
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <eosio/action.hpp>
+#include <eosio/check.hpp>
+#include <eosio/contract.hpp>
+#include <eosio/datastream.hpp>
+#include <eosio/fixed_bytes.hpp>
+#include <eosio/multi_index.hpp>
+#include <eosio/name.hpp>
+#include <eosio/print.hpp>
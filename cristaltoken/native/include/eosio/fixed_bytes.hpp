@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+namespace eosio {
+
+   /**
+    * Native stand-in for eosio::fixed_bytes, kept as big-endian 64-bit words so the
+    * ordering matches the 256-bit secondary index on chain.
+    */
+   template<std::size_t Size>
+   class fixed_bytes {
+      public:
+         static_assert( Size % 8 == 0, "native fixed_bytes only supports multiples of 8 bytes" );
+         static constexpr std::size_t num_words = Size / 8;
+
+         constexpr fixed_bytes() : _data() {}
+
+         template<typename Word, typename... Rest>
+         static fixed_bytes make_from_word_sequence( Word first_word, Rest... rest ) {
+            static_assert( std::is_same_v<Word, uint64_t>, "native fixed_bytes only supports uint64_t words" );
+            static_assert( 1 + sizeof...(Rest) == num_words, "wrong number of words" );
+            fixed_bytes r;
+            std::size_t i = 0;
+            for( uint64_t w : { first_word, static_cast<uint64_t>(rest)... } ) r._data[i++] = w;
+            return r;
+         }
+
+         const std::array<uint64_t, num_words>& get_array()const { return _data; }
+
+         friend bool operator==( const fixed_bytes& a, const fixed_bytes& b ) { return a._data == b._data; }
+         friend bool operator!=( const fixed_bytes& a, const fixed_bytes& b ) { return a._data != b._data; }
+         friend bool operator< ( const fixed_bytes& a, const fixed_bytes& b ) { return a._data <  b._data; }
+
+      private:
+         std::array<uint64_t, num_words> _data;
+   };
+
+   using checksum512 = fixed_bytes<64>;
+   using checksum256 = fixed_bytes<32>;
+
+} /// namespace eosio
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <eosio/check.hpp>
+#include <eosio/name.hpp>
+#include <eosio/native/runtime.hpp>
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <set>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+
+typedef unsigned __int128 uint128_t;
+
+namespace eosio {
+
+   constexpr static inline name same_payer{};
+
+   template<name::raw IndexName, typename Extractor>
+   struct indexed_by {
+      enum constants { index_name = static_cast<uint64_t>(IndexName) };
+      typedef Extractor secondary_extractor_type;
+   };
+
+   template<class Class, typename Type, Type (Class::*PtrToMemberFunction)()const>
+   struct const_mem_fun {
+      typedef std::remove_cv_t<std::remove_reference_t<Type>> result_type;
+
+      result_type operator()( const Class& c )const { return (c.*PtrToMemberFunction)(); }
+   };
+
+   namespace native {
+
+      /**
+       * In-memory rows of one (code, scope, table) with every secondary index kept
+       * as an ordered set of (key, primary key), the same order nodeos iterates in.
+       */
+      template<typename T, typename... Indices>
+      struct table_storage : table_base {
+         template<typename Index>
+         using key_set = std::set<std::pair<typename Index::secondary_extractor_type::result_type, uint64_t>>;
+
+         std::map<uint64_t, T>           rows;
+         std::tuple<key_set<Indices>...> indexes;
+
+         void insert( const T& obj ) {
+            auto pk = obj.primary_key();
+            rows.emplace( pk, obj );
+            insert_keys( obj, pk, std::index_sequence_for<Indices...>{} );
+         }
+
+         void remove( uint64_t pk ) {
+            auto itr = rows.find( pk );
+            remove_keys( itr->second, pk, std::index_sequence_for<Indices...>{} );
+            rows.erase( itr );
+         }
+
+         void replace( const T& obj ) {
+            auto pk  = obj.primary_key();
+            auto itr = rows.find( pk );
+            update_keys( itr->second, obj, pk, std::index_sequence_for<Indices...>{} );
+            itr->second = obj;
+         }
+
+         template<std::size_t... I>
+         void insert_keys( const T& obj, uint64_t pk, std::index_sequence<I...> ) {
+            ( std::get<I>(indexes).emplace( typename Indices::secondary_extractor_type()(obj), pk ), ... );
+         }
+
+         // Index entries are moved rather than recreated so that iterators held by
+         // the caller stay valid across a modify, as they do on chain.
+         template<std::size_t... I>
+         void update_keys( const T& previous, const T& obj, uint64_t pk, std::index_sequence<I...> ) {
+            ( update_key<I, Indices>( previous, obj, pk ), ... );
+         }
+
+         template<std::size_t I, typename Index>
+         void update_key( const T& previous, const T& obj, uint64_t pk ) {
+            auto key = typename Index::secondary_extractor_type()( obj );
+            auto old = typename Index::secondary_extractor_type()( previous );
+            if( key == old ) return;
+            auto& keys = std::get<I>(indexes);
+            auto node  = keys.extract( std::make_pair( old, pk ) );
+            node.value().first = key;
+            keys.insert( std::move(node) );
+         }
+
+         template<std::size_t... I>
+         void remove_keys( const T& obj, uint64_t pk, std::index_sequence<I...> ) {
+            ( std::get<I>(indexes).erase( std::make_pair( typename Indices::secondary_extractor_type()(obj), pk ) ), ... );
+         }
+      };
+
+   } /// namespace native
+
+   /**
+    * Native stand-in for eosio::multi_index backed by `native::table_storage`.
+    *
+    * @details Mirrors the CDT interface used by contracts (find/get/emplace/modify/erase,
+    * secondary indexes through get_index) and its assertion messages. Writes are
+    * journaled so that a failing action is rolled back.
+    */
+   template<name::raw TableName, typename T, typename... Indices>
+   class multi_index {
+      public:
+         using storage_type = native::table_storage<T, Indices...>;
+         using rows_type    = std::map<uint64_t, T>;
+
+         struct const_iterator {
+            using iterator_category = std::bidirectional_iterator_tag;
+            using value_type        = T;
+            using difference_type   = std::ptrdiff_t;
+            using pointer           = const T*;
+            using reference         = const T&;
+
+            const T& operator*()const  { return itr->second; }
+            const T* operator->()const { return &itr->second; }
+
+            const_iterator& operator++() { ++itr; return *this; }
+            const_iterator& operator--() { --itr; return *this; }
+            const_iterator  operator++(int) { auto r = *this; ++itr; return r; }
+            const_iterator  operator--(int) { auto r = *this; --itr; return r; }
+
+            friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a.itr == b.itr; }
+            friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a.itr != b.itr; }
+
+            typename rows_type::const_iterator itr;
+         };
+
+         using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+         template<std::size_t I>
+         class index {
+            public:
+               using index_type = std::tuple_element_t<I, std::tuple<Indices...>>;
+               using secondary_key_type = typename index_type::secondary_extractor_type::result_type;
+               using key_set = typename storage_type::template key_set<index_type>;
+
+               struct const_iterator {
+                  using iterator_category = std::bidirectional_iterator_tag;
+                  using value_type        = T;
+                  using difference_type   = std::ptrdiff_t;
+                  using pointer           = const T*;
+                  using reference         = const T&;
+
+                  const T& operator*()const  { return table->rows.find( itr->second )->second; }
+                  const T* operator->()const { return &**this; }
+
+                  const_iterator& operator++() { ++itr; return *this; }
+                  const_iterator& operator--() { --itr; return *this; }
+                  const_iterator  operator++(int) { auto r = *this; ++itr; return r; }
+                  const_iterator  operator--(int) { auto r = *this; --itr; return r; }
+
+                  friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a.itr == b.itr; }
+                  friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a.itr != b.itr; }
+
+                  typename key_set::const_iterator itr;
+                  storage_type*                    table;
+               };
+
+               using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+               explicit index( multi_index* mi ) : _multidx(mi) {}
+
+               static constexpr uint64_t name() { return index_type::index_name; }
+
+               const_iterator cbegin()const { return make( keys().begin() ); }
+               const_iterator begin()const  { return cbegin(); }
+               const_iterator cend()const   { return make( keys().end() ); }
+               const_iterator end()const    { return cend(); }
+
+               const_reverse_iterator rbegin()const { return const_reverse_iterator( cend() ); }
+               const_reverse_iterator rend()const   { return const_reverse_iterator( cbegin() ); }
+
+               const_iterator lower_bound( const secondary_key_type& key )const {
+                  return make( keys().lower_bound( std::make_pair( key, uint64_t(0) ) ) );
+               }
+
+               const_iterator upper_bound( const secondary_key_type& key )const {
+                  return make( keys().upper_bound( std::make_pair( key, UINT64_MAX ) ) );
+               }
+
+               const_iterator find( const secondary_key_type& key )const {
+                  auto itr = lower_bound( key );
+                  if( itr == cend() || itr.itr->first != key ) return cend();
+                  return itr;
+               }
+
+               const_iterator require_find( const secondary_key_type& key, const char* error_msg = "unable to find secondary key" )const {
+                  auto itr = find( key );
+                  check( itr != cend(), error_msg );
+                  return itr;
+               }
+
+               const T& get( const secondary_key_type& key, const char* error_msg = "unable to find secondary key" )const {
+                  return *require_find( key, error_msg );
+               }
+
+               const_iterator iterator_to( const T& obj )const {
+                  auto key = typename index_type::secondary_extractor_type()( obj );
+                  return make( keys().find( std::make_pair( key, obj.primary_key() ) ) );
+               }
+
+               template<typename Lambda>
+               void modify( const_iterator itr, eosio::name payer, Lambda&& updater ) {
+                  check( itr != cend(), "cannot pass end iterator to modify" );
+                  _multidx->modify( *itr, payer, std::forward<Lambda>(updater) );
+               }
+
+               const_iterator erase( const_iterator itr ) {
+                  check( itr != cend(), "cannot pass end iterator to erase" );
+                  const auto& obj = *itr;
+                  ++itr;
+                  _multidx->erase( obj );
+                  return itr;
+               }
+
+               eosio::name get_code()const  { return _multidx->get_code(); }
+               uint64_t    get_scope()const { return _multidx->get_scope(); }
+
+            private:
+               const key_set& keys()const { return std::get<I>( _multidx->_table->indexes ); }
+               const_iterator make( typename key_set::const_iterator itr )const { return const_iterator{ itr, _multidx->_table }; }
+
+               multi_index* _multidx;
+         };
+
+         multi_index( name code, uint64_t scope ) : _code(code), _scope(scope) {
+            auto& slot = native::table_slot( code, scope, name(TableName) );
+            if( !slot ) slot = std::make_unique<storage_type>();
+            _table = dynamic_cast<storage_type*>( slot.get() );
+            check( _table != nullptr, "table was opened with a different row type" );
+         }
+
+         name     get_code()const  { return _code; }
+         uint64_t get_scope()const { return _scope; }
+
+         const_iterator cbegin()const { return const_iterator{ _table->rows.cbegin() }; }
+         const_iterator begin()const  { return cbegin(); }
+         const_iterator cend()const   { return const_iterator{ _table->rows.cend() }; }
+         const_iterator end()const    { return cend(); }
+
+         const_reverse_iterator rbegin()const { return const_reverse_iterator( cend() ); }
+         const_reverse_iterator rend()const   { return const_reverse_iterator( cbegin() ); }
+
+         const_iterator lower_bound( uint64_t primary )const { return const_iterator{ _table->rows.lower_bound( primary ) }; }
+         const_iterator upper_bound( uint64_t primary )const { return const_iterator{ _table->rows.upper_bound( primary ) }; }
+
+         uint64_t available_primary_key()const {
+            return _table->rows.empty() ? 0 : _table->rows.rbegin()->first + 1;
+         }
+
+         const_iterator find( uint64_t primary )const { return const_iterator{ _table->rows.find( primary ) }; }
+
+         const_iterator require_find( uint64_t primary, const char* error_msg = "unable to find key" )const {
+            auto itr = find( primary );
+            check( itr != cend(), error_msg );
+            return itr;
+         }
+
+         const T& get( uint64_t primary, const char* error_msg = "unable to find key" )const {
+            return *require_find( primary, error_msg );
+         }
+
+         const_iterator iterator_to( const T& obj )const { return find( obj.primary_key() ); }
+
+         template<name::raw IndexName>
+         auto get_index() {
+            constexpr std::size_t pos = index_position<static_cast<uint64_t>(IndexName)>();
+            static_assert( pos < sizeof...(Indices), "name provided is not the name of any secondary index within multi_index" );
+            return index<pos>( this );
+         }
+
+         template<typename Lambda>
+         const_iterator emplace( name payer, Lambda&& constructor ) {
+            check( payer.value != 0, "must specify a valid account to pay for new record" );
+            T obj{};
+            constructor( obj );
+            auto pk = obj.primary_key();
+            check( _table->rows.find( pk ) == _table->rows.end(), "could not insert object, most likely a uniqueness constraint was violated" );
+            _table->insert( obj );
+            auto table = _table;
+            native::record_undo( [table, pk]() { table->remove( pk ); } );
+            return find( pk );
+         }
+
+         template<typename Lambda>
+         void modify( const_iterator itr, name payer, Lambda&& updater ) {
+            check( itr != cend(), "cannot pass end iterator to modify" );
+            modify( *itr, payer, std::forward<Lambda>(updater) );
+         }
+
+         template<typename Lambda>
+         void modify( const T& obj, name payer, Lambda&& updater ) {
+            auto itr = _table->rows.find( obj.primary_key() );
+            check( itr != _table->rows.end() && &itr->second == &obj, "object passed to modify is not in multi_index" );
+            T updated = obj;
+            updater( updated );
+            check( updated.primary_key() == obj.primary_key(), "updater cannot change primary key when modifying an object" );
+            T previous = obj;
+            _table->replace( updated );
+            auto table = _table;
+            native::record_undo( [table, previous]() { table->replace( previous ); } );
+         }
+
+         const_iterator erase( const_iterator itr ) {
+            check( itr != cend(), "cannot pass end iterator to erase" );
+            const auto& obj = *itr;
+            ++itr;
+            erase( obj );
+            return itr;
+         }
+
+         void erase( const T& obj ) {
+            auto pk = obj.primary_key();
+            check( _table->rows.find( pk ) != _table->rows.end(), "object passed to erase is not in multi_index" );
+            T previous = obj;
+            _table->remove( pk );
+            auto table = _table;
+            native::record_undo( [table, previous]() { table->insert( previous ); } );
+         }
+
+      private:
+         template<uint64_t IndexName, std::size_t I = 0>
+         static constexpr std::size_t index_position() {
+            if constexpr( I == sizeof...(Indices) ) {
+               return I;
+            } else if constexpr( std::tuple_element_t<I, std::tuple<Indices...>>::index_name == IndexName ) {
+               return I;
+            } else {
+               return index_position<IndexName, I + 1>();
+            }
+         }
+
+         name           _code;
+         uint64_t       _scope;
+         storage_type*  _table;
+   };
+
+} /// namespace eosio
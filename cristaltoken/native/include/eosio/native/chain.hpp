@@ -0,0 +1,112 @@
+#pragma once
+
+#include <eosio/action.hpp>
+#include <eosio/asset.hpp>
+#include <eosio/name.hpp>
+#include <eosio/native/runtime.hpp>
+#include <eosio/time.hpp>
+
+#include <any>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace eosio { namespace native {
+
+   /**
+    * One executed action of the last transaction, in execution order.
+    */
+   struct action_trace {
+      name               receiver;
+      name               act;
+      std::vector<name>  actors;
+      std::vector<name>  notified;
+      std::any           return_value;
+      uint32_t           depth = 0;
+   };
+
+   /**
+    * Process-wide native chain: accounts, block clock, table storage and the
+    * action execution stack used by the contract's `require_auth`,
+    * `require_recipient`, `is_account`, `get_sender` and inline actions.
+    *
+    * @details Push actions with the contract's own `action_wrapper`s, e.g.
+    * `cristaltoken::transfer_action{ "bank"_n, {alice, "active"_n} }.send( alice, bob, q, "" );`
+    */
+   class chain {
+      public:
+         static chain& get();
+
+         void create_account( name n );
+         bool is_account( name n )const;
+
+         void           set_time( time_point_sec t );
+         void           produce( uint32_t seconds );
+         time_point_sec now()const;
+
+         /// Traces and console output of the last top-level transaction.
+         const std::vector<action_trace>& traces()const { return _traces; }
+         const std::string&               console()const { return _console; }
+
+         /// Drops every account, table and trace.
+         void reset();
+
+      private:
+         friend std::unique_ptr<table_base>& table_slot( name, uint64_t, name );
+         friend void record_undo( std::function<void()> );
+         friend void dispatch( name, name, std::vector<name>, std::function<std::any()> );
+         friend std::string& console_buffer();
+         friend void eosio::require_auth( name );
+         friend bool eosio::has_auth( name );
+         friend void eosio::require_recipient( name );
+         friend name eosio::get_sender();
+
+         struct pending_action {
+            name                          receiver;
+            name                          act;
+            std::vector<name>             actors;
+            std::function<std::any()>     body;
+            name                          sender;
+         };
+
+         struct frame {
+            pending_action                pending;
+            std::vector<name>             notified;
+            std::vector<pending_action>   inlines;
+         };
+
+         struct table_key {
+            uint64_t code;
+            uint64_t scope;
+            uint64_t table;
+
+            friend bool operator==( const table_key& a, const table_key& b ) {
+               return a.code == b.code && a.scope == b.scope && a.table == b.table;
+            }
+         };
+
+         struct table_key_hash {
+            std::size_t operator()( const table_key& k )const {
+               uint64_t h = k.code * 0x9E3779B97F4A7C15ull;
+               h ^= k.scope + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+               h ^= k.table + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+               return static_cast<std::size_t>(h);
+            }
+         };
+
+         void execute( pending_action&& a, uint32_t depth );
+
+         std::unordered_set<uint64_t>                                                    _accounts;
+         std::unordered_map<table_key, std::unique_ptr<table_base>, table_key_hash>      _tables;
+         std::vector<frame>                                                              _stack;
+         std::vector<std::function<void()>>                                              _undo;
+         std::vector<action_trace>                                                       _traces;
+         std::string                                                                     _console;
+         time_point_sec                                                                  _now;
+   };
+
+}} /// namespace eosio::native
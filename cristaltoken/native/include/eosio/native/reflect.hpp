@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace eosio { namespace native {
+
+   /**
+    * Field reflection for plain aggregates (table rows, action structs), standing in
+    * for the serializers the CDT generates for every `[[eosio::table]]` struct.
+    */
+   namespace detail {
+      struct any_field {
+         template<typename T>
+         operator T()const;
+      };
+
+      template<typename T, typename... Fields>
+      constexpr std::size_t field_count() {
+         if constexpr( requires { T{ Fields{}..., any_field{} }; } )
+            return field_count<T, Fields..., any_field>();
+         else
+            return sizeof...(Fields);
+      }
+   }
+
+   template<typename T>
+   inline constexpr std::size_t field_count_v = detail::field_count<std::remove_cv_t<T>>();
+
+   /**
+    * Calls `f` with every field of the aggregate `obj`, in declaration order.
+    */
+   template<typename T, typename F>
+   void for_each_field( T&& obj, F&& f ) {
+      constexpr auto n = field_count_v<std::remove_reference_t<T>>;
+      static_assert( n <= 12, "for_each_field supports up to 12 fields" );
+      if constexpr( n == 1 ) { auto& [a] = obj; f(a); }
+      else if constexpr( n == 2 ) { auto& [a,b] = obj; f(a); f(b); }
+      else if constexpr( n == 3 ) { auto& [a,b,c] = obj; f(a); f(b); f(c); }
+      else if constexpr( n == 4 ) { auto& [a,b,c,d] = obj; f(a); f(b); f(c); f(d); }
+      else if constexpr( n == 5 ) { auto& [a,b,c,d,e] = obj; f(a); f(b); f(c); f(d); f(e); }
+      else if constexpr( n == 6 ) { auto& [a,b,c,d,e,g] = obj; f(a); f(b); f(c); f(d); f(e); f(g); }
+      else if constexpr( n == 7 ) { auto& [a,b,c,d,e,g,h] = obj; f(a); f(b); f(c); f(d); f(e); f(g); f(h); }
+      else if constexpr( n == 8 ) { auto& [a,b,c,d,e,g,h,i] = obj; f(a); f(b); f(c); f(d); f(e); f(g); f(h); f(i); }
+      else if constexpr( n == 9 ) { auto& [a,b,c,d,e,g,h,i,j] = obj; f(a); f(b); f(c); f(d); f(e); f(g); f(h); f(i); f(j); }
+      else if constexpr( n == 10 ) { auto& [a,b,c,d,e,g,h,i,j,k] = obj; f(a); f(b); f(c); f(d); f(e); f(g); f(h); f(i); f(j); f(k); }
+      else if constexpr( n == 11 ) { auto& [a,b,c,d,e,g,h,i,j,k,l] = obj; f(a); f(b); f(c); f(d); f(e); f(g); f(h); f(i); f(j); f(k); f(l); }
+      else if constexpr( n == 12 ) { auto& [a,b,c,d,e,g,h,i,j,k,l,m] = obj; f(a); f(b); f(c); f(d); f(e); f(g); f(h); f(i); f(j); f(k); f(l); f(m); }
+   }
+
+}} /// namespace eosio::native
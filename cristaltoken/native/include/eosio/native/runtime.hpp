@@ -0,0 +1,44 @@
+#pragma once
+
+#include <eosio/name.hpp>
+
+#include <any>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace eosio { namespace native {
+
+   /**
+    * Type-erased base of every in-memory table; see `table_storage` in multi_index.hpp.
+    */
+   struct table_base {
+      virtual ~table_base() = default;
+   };
+
+   /**
+    * Returns the storage slot for (code, scope, table), empty if the table was never touched.
+    */
+   std::unique_ptr<table_base>& table_slot( name code, uint64_t scope, name table );
+
+   /**
+    * Registers the inverse of a table write so that a failed action can be rolled back.
+    */
+   void record_undo( std::function<void()> undo );
+
+   /**
+    * Runs `body` as action `act` of `receiver` authorized by `actors`.
+    *
+    * @details Called from outside an action this is a top-level transaction: inline
+    * actions run depth first after the body and everything is rolled back if any of
+    * them fails. Called from inside an action the call is queued as an inline action.
+    */
+   void dispatch( name receiver, name act, std::vector<name> actors, std::function<std::any()> body );
+
+   /**
+    * Console output of the running transaction, appended to by `eosio::print`.
+    */
+   std::string& console_buffer();
+
+}} /// namespace eosio::native
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <eosio/asset.hpp>
+#include <eosio/name.hpp>
+#include <eosio/native/runtime.hpp>
+
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace eosio {
+
+   namespace native {
+      inline void print_one( std::string_view s )      { console_buffer().append( s ); }
+      inline void print_one( const char* s )           { console_buffer().append( s ); }
+      inline void print_one( const std::string& s )    { console_buffer().append( s ); }
+      inline void print_one( char c )                  { console_buffer().push_back( c ); }
+      inline void print_one( bool b )                  { console_buffer().append( b ? "true" : "false" ); }
+      inline void print_one( name n )                  { console_buffer().append( n.to_string() ); }
+      inline void print_one( const symbol_code& s )    { console_buffer().append( s.to_string() ); }
+      inline void print_one( const symbol& s )         { console_buffer().append( s.to_string() ); }
+      inline void print_one( const asset& a )          { console_buffer().append( a.to_string() ); }
+
+      template<typename T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char>, int> = 0>
+      void print_one( T v ) { console_buffer().append( std::to_string( v ) ); }
+   }
+
+   template<typename... Args>
+   void print( Args&&... args ) {
+      ( native::print_one( std::forward<Args>(args) ), ... );
+   }
+
+} /// namespace eosio
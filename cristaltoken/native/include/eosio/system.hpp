@@ -0,0 +1,14 @@
+#pragma once
+
+#include <eosio/time.hpp>
+
+namespace eosio {
+
+   /**
+    * Current block time; natively this is the controllable clock of `native::chain`.
+    */
+   time_point current_time_point();
+
+   inline time_point_sec current_block_time() { return time_point_sec( current_time_point() ); }
+
+} /// namespace eosio
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+namespace eosio {
+
+   class microseconds {
+      public:
+         constexpr explicit microseconds( int64_t c = 0 ) : _count(c) {}
+         constexpr int64_t count()const { return _count; }
+         constexpr int64_t to_seconds()const { return _count / 1000000; }
+
+         friend constexpr bool operator==( const microseconds& a, const microseconds& b ) { return a._count == b._count; }
+         friend constexpr bool operator< ( const microseconds& a, const microseconds& b ) { return a._count <  b._count; }
+
+         int64_t _count;
+   };
+
+   inline constexpr microseconds seconds( int64_t s ) { return microseconds( s * 1000000 ); }
+   inline constexpr microseconds days( int64_t d )    { return seconds( d * 24 * 60 * 60 ); }
+
+   class time_point {
+      public:
+         constexpr explicit time_point( microseconds e = microseconds() ) : elapsed(e) {}
+         constexpr const microseconds& time_since_epoch()const { return elapsed; }
+         constexpr uint32_t sec_since_epoch()const { return uint32_t( elapsed.count() / 1000000 ); }
+
+         friend constexpr bool operator==( const time_point& a, const time_point& b ) { return a.elapsed == b.elapsed; }
+         friend constexpr bool operator< ( const time_point& a, const time_point& b ) { return a.elapsed <  b.elapsed; }
+
+         microseconds elapsed;
+   };
+
+   class time_point_sec {
+      public:
+         constexpr time_point_sec() : utc_seconds(0) {}
+         constexpr explicit time_point_sec( uint32_t seconds ) : utc_seconds(seconds) {}
+         constexpr time_point_sec( const time_point& t ) : utc_seconds( t.sec_since_epoch() ) {}
+
+         constexpr uint32_t sec_since_epoch()const { return utc_seconds; }
+         constexpr operator time_point()const { return time_point( eosio::seconds( utc_seconds ) ); }
+
+         time_point_sec& operator+=( uint32_t m ) { utc_seconds += m; return *this; }
+         friend constexpr time_point_sec operator+( const time_point_sec& t, uint32_t offset ) { return time_point_sec( t.utc_seconds + offset ); }
+
+         friend constexpr bool operator==( const time_point_sec& a, const time_point_sec& b ) { return a.utc_seconds == b.utc_seconds; }
+         friend constexpr bool operator!=( const time_point_sec& a, const time_point_sec& b ) { return a.utc_seconds != b.utc_seconds; }
+         friend constexpr bool operator< ( const time_point_sec& a, const time_point_sec& b ) { return a.utc_seconds <  b.utc_seconds; }
+         friend constexpr bool operator<=( const time_point_sec& a, const time_point_sec& b ) { return a.utc_seconds <= b.utc_seconds; }
+         friend constexpr bool operator> ( const time_point_sec& a, const time_point_sec& b ) { return a.utc_seconds >  b.utc_seconds; }
+         friend constexpr bool operator>=( const time_point_sec& a, const time_point_sec& b ) { return a.utc_seconds >= b.utc_seconds; }
+
+         uint32_t utc_seconds;
+   };
+
+} /// namespace eosio
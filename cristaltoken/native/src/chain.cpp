@@ -0,0 +1,123 @@
+#include <eosio/native/chain.hpp>
+#include <eosio/system.hpp>
+
+#include <algorithm>
+
+namespace eosio {
+
+   namespace native {
+
+      constexpr uint32_t max_inline_action_depth = 4;
+
+      chain& chain::get() {
+         static chain instance;
+         return instance;
+      }
+
+      void chain::create_account( name n ) { _accounts.insert( n.value ); }
+      bool chain::is_account( name n )const { return _accounts.count( n.value ) > 0; }
+
+      void           chain::set_time( time_point_sec t ) { _now = t; }
+      void           chain::produce( uint32_t seconds )  { _now += seconds; }
+      time_point_sec chain::now()const                   { return _now; }
+
+      void chain::reset() {
+         _accounts.clear();
+         _tables.clear();
+         _stack.clear();
+         _undo.clear();
+         _traces.clear();
+         _console.clear();
+         _now = time_point_sec();
+      }
+
+      void chain::execute( pending_action&& a, uint32_t depth ) {
+         check( depth <= max_inline_action_depth, "max inline action depth per transaction reached" );
+         check( is_account( a.receiver ), "action's receiver account does not exist" );
+
+         auto trace_index = _traces.size();
+         _traces.push_back( action_trace{ a.receiver, a.act, a.actors, {}, {}, depth } );
+         _stack.push_back( frame{ std::move(a), {}, {} } );
+
+         auto result = _stack.back().pending.body();
+
+         frame done = std::move( _stack.back() );
+         _stack.pop_back();
+         _traces[trace_index].notified     = std::move( done.notified );
+         _traces[trace_index].return_value = std::move( result );
+
+         for( auto& inl : done.inlines )
+            execute( std::move(inl), depth + 1 );
+      }
+
+      std::unique_ptr<table_base>& table_slot( name code, uint64_t scope, name table ) {
+         return chain::get()._tables[ chain::table_key{ code.value, scope, table.value } ];
+      }
+
+      void record_undo( std::function<void()> undo ) {
+         auto& c = chain::get();
+         if( !c._stack.empty() ) c._undo.push_back( std::move(undo) );
+      }
+
+      void dispatch( name receiver, name act, std::vector<name> actors, std::function<std::any()> body ) {
+         auto& c = chain::get();
+         chain::pending_action a{ receiver, act, std::move(actors), std::move(body) };
+         if( !c._stack.empty() ) {
+            a.sender = c._stack.back().pending.receiver;
+            c._stack.back().inlines.push_back( std::move(a) );
+            return;
+         }
+
+         c._traces.clear();
+         c._console.clear();
+         c._undo.clear();
+         try {
+            c.execute( std::move(a), 0 );
+         } catch( ... ) {
+            for( auto itr = c._undo.rbegin(); itr != c._undo.rend(); ++itr ) (*itr)();
+            c._undo.clear();
+            c._stack.clear();
+            throw;
+         }
+         c._undo.clear();
+      }
+
+      std::string& console_buffer() { return chain::get()._console; }
+
+   } /// namespace native
+
+   void require_auth( name n ) {
+      check( has_auth( n ), "missing authority of " + n.to_string() );
+   }
+
+   bool has_auth( name n ) {
+      auto& c = native::chain::get();
+      if( c._stack.empty() ) return false;
+      const auto& actors = c._stack.back().pending.actors;
+      return std::find( actors.begin(), actors.end(), n ) != actors.end();
+   }
+
+   bool is_account( name n ) {
+      return native::chain::get().is_account( n );
+   }
+
+   void require_recipient( name notify_account ) {
+      auto& c = native::chain::get();
+      check( !c._stack.empty(), "require_recipient called outside of an action" );
+      auto& f = c._stack.back();
+      if( notify_account == f.pending.receiver ) return;
+      if( std::find( f.notified.begin(), f.notified.end(), notify_account ) == f.notified.end() )
+         f.notified.push_back( notify_account );
+   }
+
+   name get_sender() {
+      auto& c = native::chain::get();
+      check( !c._stack.empty(), "get_sender called outside of an action" );
+      return c._stack.back().pending.sender;
+   }
+
+   time_point current_time_point() {
+      return time_point( native::chain::get().now() );
+   }
+
+} /// namespace eosio
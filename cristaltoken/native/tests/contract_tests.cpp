@@ -0,0 +1,757 @@
+// Contract tests on the native chain.
+//
+// Every test starts from an empty chain with the bank account, the INK token created by
+// it and the clock at `start_time`, pushes actions through the contract's action_wrappers
+// and checks balances, supply and table rows afterwards. Failing actions are rolled back
+// by the native chain, as on chain.
+//
+//    cristaltoken_contract_tests [test ...]
+//
+// Runs the named tests, or all of them; the exit status is 1 if any failed.
+
+#include <cristaltoken.hpp>
+#include <eosio/native/chain.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace eosio;
+using ct = cristaltoken;
+
+namespace {
+
+   constexpr uint32_t start_time = 1600000000;
+   constexpr uint32_t period     = ct::REQUIRED_PERIOD_DURATION;
+   const symbol       token( "INK", 4 );
+   const name         bank     = "bank"_n;
+   const name         admin    = "admin"_n;
+   const name         provider = "provider"_n;
+   const name         alice    = "alice"_n;
+   const name         bob      = "bob"_n;
+   const name         carol    = "carol"_n;
+
+   using pap_row = decltype( std::declval<ct::pap_table::const_iterator::value_type>().view() );
+
+   struct test_failure {
+      std::string message;
+   };
+
+   void expect( bool cond, const std::string& what, int line ) {
+      if( !cond )
+         throw test_failure{ "line " + std::to_string( line ) + ": " + what };
+   }
+
+   #define EXPECT( cond ) expect( (cond), #cond, __LINE__ )
+   #define EXPECT_EQ( a, b ) expect( (a) == (b), #a " == " #b " (got " + describe( a ) + ")", __LINE__ )
+   #define EXPECT_FAIL( push ) \
+      do { \
+         bool failed = false; \
+         try { push; } catch( const native::assertion_failure& ) { failed = true; } \
+         expect( failed, "expected to fail: " #push, __LINE__ ); \
+      } while( 0 )
+
+   std::string describe( const asset& a ) { return a.to_string(); }
+   template<typename T>
+   std::string describe( const T& v ) { return std::to_string( v ); }
+
+   asset ink( int64_t units ) { return asset( units * 10000, token ); }
+
+   permission_level active( name n ) { return { n, "active"_n }; }
+
+   // Balance of `owner`, zero when it has no balance row.
+   asset balance( name owner ) {
+      try {
+         return ct::get_balance( bank, owner, token.code() );
+      } catch( const native::assertion_failure& ) {
+         return ink( 0 );
+      }
+   }
+
+   asset supply() { return ct::get_supply( bank, token.code() ); }
+
+   asset accrued_fees() {
+      multi_index<"feepool"_n, ct::feepool_row> pool( bank, bank.value );
+      auto it = pool.find( token.code().raw() );
+      return it == pool.end() ? ink( 0 ) : it->accrued;
+   }
+
+   template<typename Result>
+   Result returned() {
+      return std::any_cast<Result>( native::chain::get().traces().front().return_value );
+   }
+
+   // Whether `account` was notified by the first action of the last transaction.
+   bool notified( name account ) {
+      for( auto n : native::chain::get().traces().front().notified )
+         if( n == account )
+            return true;
+      return false;
+   }
+
+   std::optional<pap_row> find_pap( uint64_t id ) {
+      ct::pap_table paps( bank, bank.value );
+      auto it = paps.find( id );
+      if( it == paps.end() )
+         return std::nullopt;
+      return it->view();
+   }
+
+   size_t pap_rows() {
+      ct::pap_table paps( bank, bank.value );
+      return std::distance( paps.begin(), paps.end() );
+   }
+
+   uint8_t config_flags() {
+      singleton<"config"_n, ct::config_row> config( bank, bank.value );
+      return config.get().flags;
+   }
+
+   void customer( name to, int64_t fee_units, int64_t overdraft_units, uint32_t type ) {
+      native::chain::get().create_account( to );
+      ct::upsertcust_action( bank, active( bank ) ).send( to, asset( fee_units, token ), ink( overdraft_units ),
+                                                          type, ct::STATE_ENABLED, std::string() );
+   }
+
+   void issue( name to, int64_t units ) {
+      ct::issue_action( bank, active( bank ) ).send( to, ink( units ), std::string() );
+   }
+
+   void pap( name from, uint32_t service, int64_t price_units, uint32_t periods ) {
+      ct::upsertpap_action( bank, active( from ) ).send( from, provider, service, ink( price_units ),
+                                                         start_time, periods, 0u, 1u, std::string() );
+   }
+
+   void chargepap( name from, uint32_t service, int64_t price_units ) {
+      ct::chargepap_action( bank, active( provider ) ).send( from, provider, service, ink( price_units ), std::string() );
+   }
+
+   void chargeall( uint32_t service, uint32_t max_rows ) {
+      ct::chargeall_action( bank, active( provider ) ).send( provider, service, max_rows, std::string() );
+   }
+
+   void block_pap( name from, uint32_t service ) {
+      ct::upsertpap_action( bank, active( bank ) ).send( from, provider, service, ink( 0 ), 0u, 0u, 0u,
+                                                         ct::STATE_BLOCKED, std::string() );
+   }
+
+   ct::audit_result audit() {
+      ct::audit_action( bank, active( bank ) ).send( token.code(), 100u );
+      return returned<ct::audit_result>();
+   }
+
+   // Fresh chain: bank with INK created, a business provider and the clock at start_time.
+   void setup() {
+      auto& chain = native::chain::get();
+      chain.reset();
+      chain.create_account( bank );
+      chain.set_time( time_point_sec( start_time ) );
+      ct::create_action( bank, active( bank ) ).send( bank, ink( 1000000 ) );
+      customer( provider, 0, 0, ct::TYPE_ACCOUNT_BUSINESS );
+   }
+
+   void test_transfer() {
+      customer( alice, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      customer( bob, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      customer( carol, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      issue( alice, 100 );
+
+      ct::transfer_action( bank, active( alice ) ).send( alice, bob, ink( 10 ), std::string() );
+      EXPECT_EQ( balance( alice ), ink( 90 ) );
+      EXPECT_EQ( balance( bob ), ink( 10 ) );
+      EXPECT( notified( alice ) && notified( bob ) );
+
+      // One debit of the sender for the whole batch, every payee credited and notified.
+      ct::transferbatch_action( bank, active( alice ) ).send( alice, std::vector<ct::payout>{
+         { bob, ink( 5 ), "" }, { carol, ink( 20 ), "" } } );
+      EXPECT_EQ( balance( alice ), ink( 65 ) );
+      EXPECT_EQ( balance( bob ), ink( 15 ) );
+      EXPECT_EQ( balance( carol ), ink( 20 ) );
+      EXPECT( notified( bob ) && notified( carol ) );
+
+      // A batch the sender cannot cover is rolled back as a whole.
+      EXPECT_FAIL( ct::transferbatch_action( bank, active( alice ) ).send( alice, std::vector<ct::payout>{
+         { bob, ink( 60 ), "" }, { carol, ink( 6 ), "" } } ) );
+      EXPECT_FAIL( ct::transferbatch_action( bank, active( alice ) ).send( alice, std::vector<ct::payout>{
+         { bob, ink( 1 ), "" }, { alice, ink( 1 ), "" } } ) );
+      EXPECT_FAIL( ct::transferbatch_action( bank, active( alice ) ).send( alice, std::vector<ct::payout>{} ) );
+      EXPECT_EQ( balance( alice ), ink( 65 ) );
+      EXPECT_EQ( balance( bob ), ink( 15 ) );
+      EXPECT_EQ( supply(), ink( 100 ) );
+   }
+
+   void test_xfer() {
+      customer( alice, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      customer( bob, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      issue( alice, 100 );
+      ct::create_action( bank, active( bank ) ).send( bank, asset( 1000000, symbol( "OTHER", 2 ) ) );
+
+      // Deployed before create recorded the contract token: xfer needs setconfig first.
+      native::dispatch( bank, "seed"_n, { bank }, [&]() -> std::any {
+         singleton<"config"_n, ct::config_row> config( bank, bank.value );
+         config.set( ct::config_row{}, bank );
+         return {};
+      });
+      EXPECT_FAIL( ct::xfer_action( bank, active( alice ) ).send( alice, bob, int64_t( 100000 ), uint64_t( 0 ) ) );
+
+      EXPECT_FAIL( ct::setconfig_action( bank, active( alice ) ).send( token ) );
+      EXPECT_FAIL( ct::setconfig_action( bank, active( bank ) ).send( symbol( "NONE", 4 ) ) );
+      EXPECT_FAIL( ct::setconfig_action( bank, active( bank ) ).send( symbol( "INK", 2 ) ) );
+      ct::setconfig_action( bank, active( bank ) ).send( token );
+      singleton<"config"_n, ct::config_row> config( bank, bank.value );
+      EXPECT( config.get().token == token );
+
+      // Amounts are in the smallest unit of the contract token; `ref` is not recorded.
+      ct::xfer_action( bank, active( alice ) ).send( alice, bob, int64_t( 100000 ), uint64_t( 42 ) );
+      auto result = returned<ct::transfer_result>();
+      EXPECT_EQ( result.from_balance, ink( 90 ) );
+      EXPECT_EQ( result.to_balance, ink( 10 ) );
+      EXPECT( notified( alice ) && notified( bob ) );
+      EXPECT_FAIL( ct::xfer_action( bank, active( bob ) ).send( bob, alice, int64_t( 100001 ), uint64_t( 0 ) ) );
+      EXPECT_FAIL( ct::xfer_action( bank, active( bob ) ).send( bob, alice, int64_t( -1 ), uint64_t( 0 ) ) );
+
+      // Once set, the contract token stays: packed customer amounts carry no symbol.
+      ct::setconfig_action( bank, active( bank ) ).send( token );
+      EXPECT_FAIL( ct::setconfig_action( bank, active( bank ) ).send( symbol( "OTHER", 2 ) ) );
+      EXPECT_EQ( balance( bob ), ink( 10 ) );
+   }
+
+   void test_issue() {
+      customer( alice, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      customer( bob, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+
+      // The issue credits alice itself; its inline transfer from the issuer is only a record
+      // for transfer consumers, and notifies alice.
+      issue( alice, 100 );
+      const auto& traces = native::chain::get().traces();
+      EXPECT_EQ( traces.size(), 2u );
+      EXPECT( traces[1].receiver == bank && traces[1].act == "transfer"_n );
+      EXPECT( std::count( traces[1].notified.begin(), traces[1].notified.end(), alice ) == 1 );
+      EXPECT_EQ( std::any_cast<ct::transfer_result>( traces[1].return_value ).to_balance, ink( 100 ) );
+      EXPECT_EQ( balance( alice ), ink( 100 ) );
+      EXPECT_EQ( balance( bank ), ink( 0 ) );
+      EXPECT_EQ( supply(), ink( 100 ) );
+
+      // Pushed by anyone but the contract, a transfer from the issuer moves tokens.
+      EXPECT_FAIL( ct::transfer_action( bank, active( bank ) ).send( bank, bob, ink( 1 ), std::string() ) );
+   }
+
+   void test_transfer_fees() {
+      customer( alice, 5000, 0, ct::TYPE_ACCOUNT_PERSONAL );      // 0.5000 INK per debit
+      customer( bob, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      customer( admin, 0, 0, ct::TYPE_ACCOUNT_BANK_ADMIN );
+      issue( alice, 100 );
+
+      ct::transfer_action( bank, active( alice ) ).send( alice, bob, ink( 10 ), std::string() );
+      EXPECT_EQ( balance( alice ), asset( 895000, token ) );
+      EXPECT_EQ( balance( bob ), ink( 10 ) );
+
+      // The fee is taken once per payout of a batch.
+      ct::transferbatch_action( bank, active( alice ) ).send( alice, std::vector<ct::payout>{
+         { bob, ink( 1 ), "" }, { admin, ink( 2 ), "" } } );
+      EXPECT_EQ( balance( alice ), asset( 855000, token ) );
+
+      // chargepap debits it as well.
+      pap( alice, 7, 10, 5 );
+      native::chain::get().produce( period + 60 );
+      chargepap( alice, 7, 10 );
+      EXPECT_EQ( balance( alice ), asset( 750000, token ) );
+
+      // Only a bank admin customer can be paid the fees.
+      EXPECT_FAIL( ct::settlefees_action( bank, active( bank ) ).send( bob, token.code(), std::string() ) );
+      ct::settlefees_action( bank, active( bank ) ).send( admin, token.code(), std::string() );
+      EXPECT_EQ( balance( admin ), ink( 4 ) );
+      EXPECT_FAIL( ct::settlefees_action( bank, active( bank ) ).send( admin, token.code(), std::string() ) );
+      EXPECT_EQ( supply(), ink( 100 ) );
+   }
+
+   void test_chargepap() {
+      customer( alice, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      issue( alice, 100 );
+      pap( alice, 7, 10, 2 );
+
+      // Nothing is due before the first period has elapsed, nor at another price.
+      EXPECT_FAIL( chargepap( alice, 7, 10 ) );
+      native::chain::get().produce( period + 60 );
+      EXPECT_FAIL( chargepap( alice, 7, 11 ) );
+
+      chargepap( alice, 7, 10 );
+      EXPECT_EQ( balance( alice ), ink( 90 ) );
+      EXPECT_EQ( balance( provider ), ink( 10 ) );
+      EXPECT_EQ( find_pap( 0 )->last_charged, 1 );
+      EXPECT_FAIL( chargepap( alice, 7, 10 ) );
+
+      // The last period ends the PAP.
+      native::chain::get().produce( period );
+      chargepap( alice, 7, 10 );
+      native::chain::get().produce( period );
+      EXPECT_FAIL( chargepap( alice, 7, 10 ) );
+      EXPECT_EQ( balance( alice ), ink( 80 ) );
+   }
+
+   void test_bydue() {
+      for( auto n : { alice, bob, carol } ) {
+         customer( n, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+         issue( n, 100 );
+      }
+      for( auto n : { alice, bob, carol } )
+         pap( n, 7, 10, 5 );
+      native::chain::get().produce( period + 60 );
+      chargepap( alice, 7, 10 );
+      block_pap( bob, 7 );
+
+      // Running PAPs by next due time, blocked ones last: a sweep up to now only sees carol.
+      ct::pap_table paps( bank, bank.value );
+      auto due = paps.get_index<"bydue"_n>();
+      auto it = due.begin();
+      EXPECT( it->account == carol );
+      EXPECT_EQ( it->by_due(), uint64_t( start_time + period ) );
+      ++it;
+      EXPECT( it->account == alice );
+      EXPECT_EQ( it->by_due(), uint64_t( start_time + 2 * period ) );
+      ++it;
+      EXPECT( it->account == bob );
+      EXPECT_EQ( it->by_due(), ct::PAP_DUE_INACTIVE + native::chain::get().now().sec_since_epoch() );
+      EXPECT( ++it == due.end() );
+      EXPECT( due.upper_bound( native::chain::get().now().sec_since_epoch() ) == std::next( due.begin() ) );
+   }
+
+   void test_catchuppap() {
+      customer( alice, 10000, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      issue( alice, 100 );
+      pap( alice, 7, 10, 5 );
+      native::chain::get().produce( 3 * period + 60 );
+
+      // Three periods are due: at most two now, the fee once per period.
+      ct::catchuppap_action( bank, active( provider ) ).send( alice, provider, 7u, ink( 10 ), 2u, std::string() );
+      EXPECT_EQ( find_pap( 0 )->last_charged, 2 );
+      EXPECT_EQ( balance( alice ), ink( 78 ) );
+      EXPECT_EQ( accrued_fees(), ink( 2 ) );
+
+      ct::catchuppap_action( bank, active( provider ) ).send( alice, provider, 7u, ink( 10 ), 10u, std::string() );
+      EXPECT_EQ( find_pap( 0 )->last_charged, 3 );
+      EXPECT_EQ( balance( alice ), ink( 67 ) );
+      EXPECT_EQ( balance( provider ), ink( 30 ) );
+      EXPECT_EQ( accrued_fees(), ink( 3 ) );
+      EXPECT_FAIL( ct::catchuppap_action( bank, active( provider ) ).send( alice, provider, 7u, ink( 10 ), 10u, std::string() ) );
+   }
+
+   void test_chargeall() {
+      customer( alice, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      customer( bob, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      customer( carol, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      issue( alice, 100 );
+      issue( bob, 5 );                                              // cannot afford a period
+      issue( carol, 100 );
+      for( auto n : { alice, bob, carol } )
+         pap( n, 7, 10, 3 );
+      pap( alice, 8, 10, 3 );                                       // another service
+      ct::migratepaps_action( bank, active( bank ) ).send( 10u );
+      native::chain::get().produce( period + 60 );
+
+      // Two rows per call: the walk resumes from the chargecursor on the next one.
+      chargeall( 7, 2 );
+      EXPECT_EQ( balance( alice ), ink( 90 ) );
+      EXPECT_EQ( balance( carol ), ink( 100 ) );
+      chargeall( 7, 2 );
+      EXPECT_EQ( balance( alice ), ink( 90 ) );
+      EXPECT_EQ( balance( bob ), ink( 5 ) );
+      EXPECT_EQ( balance( carol ), ink( 90 ) );
+      EXPECT_EQ( balance( provider ), ink( 20 ) );
+      EXPECT_EQ( find_pap( 1 )->last_charged, 0 );
+      EXPECT_EQ( find_pap( 3 )->last_charged, 0 );
+
+      // A new walk charges nothing more until the next period.
+      chargeall( 7, 10 );
+      EXPECT_EQ( balance( provider ), ink( 20 ) );
+      EXPECT_EQ( supply(), ink( 205 ) );
+
+      // Erasing the row the cursor names moves the cursor to the row after it.
+      native::chain::get().produce( period );
+      chargeall( 7, 1 );
+      EXPECT_EQ( balance( alice ), ink( 80 ) );
+      ct::erasepap_action( bank, active( provider ) ).send( bob, provider, 7u, std::string() );
+      chargeall( 7, 1 );
+      EXPECT_EQ( balance( carol ), ink( 80 ) );
+      EXPECT_EQ( balance( provider ), ink( 40 ) );
+   }
+
+   void test_overdraft() {
+      customer( alice, 0, 50, ct::TYPE_ACCOUNT_PERSONAL );
+      customer( bob, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      issue( alice, 20 );
+
+      // The credit line lets the balance go down to -50 without issuing tokens.
+      ct::transfer_action( bank, active( alice ) ).send( alice, bob, ink( 60 ), std::string() );
+      EXPECT_EQ( balance( alice ), ink( -40 ) );
+      EXPECT_FAIL( ct::transfer_action( bank, active( alice ) ).send( alice, bob, ink( 11 ), std::string() ) );
+      EXPECT_EQ( supply(), ink( 20 ) );
+
+      // chargeall draws on the credit line of an account without a balance row.
+      customer( carol, 0, 30, ct::TYPE_ACCOUNT_PERSONAL );
+      pap( carol, 7, 10, 2 );
+      ct::migratepaps_action( bank, active( bank ) ).send( 10u );
+      native::chain::get().produce( period + 60 );
+      chargeall( 7, 10 );
+      EXPECT_EQ( balance( carol ), ink( -10 ) );
+      EXPECT_EQ( balance( provider ), ink( 10 ) );
+      EXPECT( audit().balanced );
+
+      // The issuer retires what it holds, never its credit line.
+      ct::upsertcust_action( bank, active( bank ) ).send( bank, ink( 0 ), ink( 100 ), ct::TYPE_ACCOUNT_BUSINESS,
+                                                          ct::STATE_ENABLED, std::string() );
+      issue( bank, 10 );
+      EXPECT_FAIL( ct::retire_action( bank, active( bank ) ).send( ink( 60 ), std::string() ) );
+      ct::retire_action( bank, active( bank ) ).send( ink( 10 ), std::string() );
+      EXPECT_EQ( balance( bank ), ink( 0 ) );
+      EXPECT_EQ( supply(), ink( 20 ) );
+   }
+
+   void test_migratecusts() {
+      // alice was onboarded by the old contract, in the legacy customer table, with an
+      // overdraft of 50 issued as tokens and raised to 80 since.
+      native::chain::get().create_account( alice );
+      native::chain::get().create_account( bob );
+      native::dispatch( bank, "seed"_n, { bank }, [&]() -> std::any {
+         multi_index<"customer"_n, ct::legacy_customer_row> legacy( bank, bank.value );
+         legacy.emplace( bank, [&]( auto& row ) {
+            row.key = alice;
+            row.fee = ink( 0 );
+            row.overdraft = ink( 80 );
+            row.account_type = ct::TYPE_ACCOUNT_PERSONAL;
+            row.state = ct::STATE_ENABLED;
+         });
+         return {};
+      });
+      issue( alice, 50 );                                           // its overdraft, issued as tokens
+      issue( alice, 20 );
+
+      // Until retired the issued overdraft is spendable, the credit line is not.
+      EXPECT_FAIL( ct::transfer_action( bank, active( alice ) ).send( alice, bob, ink( 71 ), std::string() ) );
+
+      // Legacy rows are read where they are until moved; moving them retires nothing.
+      ct::transfer_action( bank, active( alice ) ).send( alice, bob, ink( 1 ), std::string() );
+      ct::migratecusts_action( bank, active( bank ) ).send( 10u );
+      multi_index<"customer"_n, ct::legacy_customer_row> legacy( bank, bank.value );
+      EXPECT( legacy.begin() == legacy.end() );
+      EXPECT( config_flags() & ct::CONFIG_FLAG_CUSTS_MIGRATED );
+      EXPECT_EQ( balance( alice ), ink( 69 ) );
+      EXPECT_EQ( supply(), ink( 70 ) );
+      EXPECT_FAIL( ct::transfer_action( bank, active( alice ) ).send( alice, bob, ink( 70 ), std::string() ) );
+
+      // The moved row is stored with the latest layout.
+      multi_index<"customers"_n, ct::customer_row> customers( bank, bank.value );
+      auto row = customers.find( alice.value );
+      EXPECT( row != customers.end() );
+      EXPECT_EQ( row->data.index(), std::variant_size_v<decltype( row->data )> - 1 );
+
+      // retireoft takes the amount issued, not the overdraft on the row.
+      EXPECT_FAIL( ct::retireoft_action( bank, active( bank ) ).send( std::vector<ct::issued_overdraft>{ { bob, ink( 0 ) } } ) );
+      ct::retireoft_action( bank, active( bank ) ).send( std::vector<ct::issued_overdraft>{ { alice, ink( 50 ) } } );
+      EXPECT_EQ( balance( alice ), ink( 19 ) );
+      EXPECT_EQ( supply(), ink( 20 ) );
+      EXPECT_FAIL( ct::retireoft_action( bank, active( bank ) ).send( std::vector<ct::issued_overdraft>{ { alice, ink( 50 ) } } ) );
+
+      ct::listcusts_action( bank, active( bank ) ).send( name(), 10u );
+      auto page = returned<ct::customer_page>();
+      EXPECT_EQ( page.rows.size(), 2u );                            // alice and provider
+      EXPECT( page.rows[0].key == alice );
+      EXPECT_EQ( page.rows[0].overdraft, ink( 80 ) );
+      EXPECT( page.rows[0].flags & ct::CUST_FLAG_CREDIT_LINE );
+
+      ct::transfer_action( bank, active( alice ) ).send( alice, bob, ink( 99 ), std::string() );
+      EXPECT_EQ( balance( alice ), ink( -80 ) );
+      EXPECT( audit().balanced );
+   }
+
+   void test_migratepaps() {
+      customer( alice, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      customer( bob, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      issue( alice, 100 );
+      issue( bob, 100 );
+      native::dispatch( bank, "seed"_n, { bank }, [&]() -> std::any {
+         ct::legacy_pap_table legacy( bank, bank.value );
+         uint64_t id = 4;
+         for( auto n : { alice, bob } ) {
+            legacy.emplace( bank, [&]( auto& row ) {
+               row.id = id++;
+               row.account = n;
+               row.provider = provider;
+               row.service_id = 7;
+               row.price = ink( 10 );
+               row.begins_at = time_point_sec( start_time );
+               row.periods = 2;
+               row.last_charged = 0;
+               row.enabled = 1;
+            });
+         }
+         return {};
+      });
+      native::chain::get().produce( period + 60 );
+
+      // Walks over `paps` alone would miss the legacy rows.
+      EXPECT_FAIL( chargeall( 7, 10 ) );
+      EXPECT_FAIL( ct::listprovpaps_action( bank, active( bank ) ).send( provider, std::optional<ct::pap_cursor>(), 10u ) );
+
+      // A legacy row touched by chargepap is moved on the way.
+      chargepap( bob, 7, 10 );
+      EXPECT_EQ( find_pap( 5 )->last_charged, 1 );
+      EXPECT_EQ( pap_rows(), 1u );
+
+      // A call moving its last row cannot tell the legacy table is empty yet.
+      ct::migratepaps_action( bank, active( bank ) ).send( 1u );
+      EXPECT( !( config_flags() & ct::CONFIG_FLAG_PAPS_MIGRATED ) );
+      EXPECT_EQ( pap_rows(), 2u );
+      EXPECT( find_pap( 4 )->account == alice );
+      ct::legacy_pap_table legacy( bank, bank.value );
+      EXPECT( legacy.begin() == legacy.end() );
+
+      // Then the walk over `paps` runs in bounded calls too; every row is in the newest layout.
+      ct::migratepaps_action( bank, active( bank ) ).send( 1u );
+      EXPECT( config_flags() & ct::CONFIG_FLAG_PAPS_MIGRATED );
+      ct::migratepaps_action( bank, active( bank ) ).send( 10u );
+      ct::pap_table paps( bank, bank.value );
+      for( const auto& row : paps )
+         EXPECT( is_latest( row.data ) );
+
+      chargeall( 7, 10 );
+      EXPECT_EQ( balance( alice ), ink( 90 ) );
+      EXPECT_EQ( balance( bob ), ink( 90 ) );
+      EXPECT_EQ( balance( provider ), ink( 20 ) );
+
+      // New PAPs take ids after the migrated ones.
+      pap( alice, 8, 1, 1 );
+      EXPECT( find_pap( 6 ).has_value() );
+   }
+
+   void test_prunepaps() {
+      customer( alice, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      customer( bob, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      customer( carol, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      for( auto n : { alice, bob, carol } )
+         issue( n, 100 );
+      pap( alice, 7, 10, 1 );                                       // finished once charged
+      pap( bob, 7, 10, 5 );                                         // blocked
+      pap( carol, 7, 10, 5 );                                       // still running
+      ct::migratepaps_action( bank, active( bank ) ).send( 10u );
+      native::chain::get().produce( period + 60 );
+      chargepap( alice, 7, 10 );
+      block_pap( bob, 7 );
+
+      // Finished rows go at once, blocked ones PAP_PRUNE_GRACE after they stopped.
+      ct::prunepaps_action( bank, active( bank ) ).send( 10u );
+      EXPECT_EQ( pap_rows(), 2u );
+      EXPECT( !find_pap( 0 ).has_value() );
+      native::chain::get().produce( ct::PAP_PRUNE_GRACE - 120 );
+      ct::prunepaps_action( bank, active( bank ) ).send( 10u );
+      EXPECT_EQ( pap_rows(), 2u );
+      native::chain::get().produce( 120 );
+      ct::prunepaps_action( bank, active( bank ) ).send( 10u );
+      EXPECT_EQ( pap_rows(), 1u );
+      EXPECT( find_pap( 2 ).has_value() );
+
+      // The grace runs from the block, however long ago the PAP was last due.
+      block_pap( carol, 7 );
+      ct::prunepaps_action( bank, active( bank ) ).send( 10u );
+      EXPECT( find_pap( 2 ).has_value() );
+      native::chain::get().produce( ct::PAP_PRUNE_GRACE + 60 );
+      ct::prunepaps_action( bank, active( bank ) ).send( 10u );
+      EXPECT_EQ( pap_rows(), 0u );
+   }
+
+   void test_audit() {
+      customer( alice, 5000, 20, ct::TYPE_ACCOUNT_PERSONAL );
+      customer( bob, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      issue( alice, 10 );
+      issue( bob, 10 );
+      ct::transfer_action( bank, active( alice ) ).send( alice, bob, ink( 15 ), std::string() );
+
+      // One holder per call: balance changes meanwhile are applied to the running sum.
+      ct::audit_action( bank, active( bank ) ).send( token.code(), 1u );
+      EXPECT( !returned<ct::audit_result>().done );
+      ct::transfer_action( bank, active( bob ) ).send( bob, alice, ink( 5 ), std::string() );
+      issue( alice, 3 );
+      ct::audit_action( bank, active( bank ) ).send( token.code(), 1u );
+      auto result = returned<ct::audit_result>();
+      EXPECT( result.done );
+      EXPECT( result.balanced );
+      EXPECT_EQ( result.holders, 2u );
+      EXPECT_EQ( result.fees, asset( 5000, token ) );
+      EXPECT_EQ( result.supply, ink( 23 ) );
+
+      // A balance changed behind the contract's back is caught.
+      multi_index<"accounts"_n, ct::account_row> accounts( bank, bob.value );
+      accounts.modify( accounts.find( token.code().raw() ), bank, []( auto& row ) { row.balance.amount += 1; } );
+      EXPECT( !audit().balanced );
+   }
+
+   void test_setnotify() {
+      customer( alice, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      customer( admin, 0, 0, ct::TYPE_ACCOUNT_BANK_ADMIN );
+      issue( alice, 100 );
+      issue( admin, 100 );
+      pap( alice, 7, 10, 5 );
+      native::chain::get().produce( period + 60 );
+
+      chargepap( alice, 7, 10 );
+      EXPECT( notified( alice ) );
+
+      // Only the customer or the bank may opt out.
+      EXPECT_FAIL( ct::setnotify_action( bank, active( admin ) ).send( alice, false ) );
+      ct::setnotify_action( bank, active( alice ) ).send( alice, false );
+      native::chain::get().produce( period );
+      chargepap( alice, 7, 10 );
+      EXPECT( !notified( alice ) );
+      EXPECT( notified( provider ) );
+
+      // Bank paid batches honour it; transfers signed by the account do not.
+      ct::transferbatch_action( bank, active( admin ) ).send( admin, std::vector<ct::payout>{ { alice, ink( 1 ), "" } } );
+      EXPECT( !notified( alice ) );
+      ct::transfer_action( bank, active( admin ) ).send( admin, alice, ink( 1 ), std::string() );
+      EXPECT( notified( alice ) );
+   }
+
+   void test_results() {
+      customer( alice, 10000, 0, ct::TYPE_ACCOUNT_PERSONAL );     // 1 INK per debit
+      customer( bob, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+      issue( alice, 100 );
+      pap( alice, 7, 10, 5 );
+
+      ct::transfer_action( bank, active( alice ) ).send( alice, bob, ink( 10 ), std::string() );
+      auto transferred = returned<ct::transfer_result>();
+      EXPECT_EQ( transferred.from_balance, ink( 89 ) );
+      EXPECT_EQ( transferred.to_balance, ink( 10 ) );
+
+      native::chain::get().produce( period + 60 );
+      ct::chargepap_action( bank, active( provider ) ).send( alice, provider, 7u, ink( 10 ), std::string() );
+      auto charged = returned<ct::charge_result>();
+      EXPECT_EQ( charged.from_balance, ink( 78 ) );
+      EXPECT_EQ( charged.to_balance, ink( 10 ) );
+      EXPECT_EQ( charged.last_charged, 1 );
+      EXPECT_EQ( charged.remaining, 4 );
+      EXPECT_EQ( charged.next_due.sec_since_epoch(), start_time + 2 * period );
+   }
+
+   void test_queries() {
+      for( auto n : { alice, bob, carol } ) {
+         customer( n, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+         pap( n, 7, 10, 5 );
+      }
+      pap( alice, 8, 10, 5 );
+      ct::migratepaps_action( bank, active( bank ) ).send( 10u );
+
+      // Two rows per page, `next` leads to the following one.
+      ct::listprovpaps_action( bank, active( bank ) ).send( provider, std::optional<ct::pap_cursor>(), 2u );
+      auto page = returned<ct::pap_page>();
+      EXPECT_EQ( page.rows.size(), 2u );
+      EXPECT( page.rows[0].account == alice && page.rows[1].account == bob );
+      EXPECT( page.next.has_value() );
+      ct::listprovpaps_action( bank, active( bank ) ).send( provider, page.next, 2u );
+      page = returned<ct::pap_page>();
+      EXPECT_EQ( page.rows.size(), 2u );
+      EXPECT( page.rows[0].account == carol && page.rows[1].service_id == 8 );
+      EXPECT( !page.next.has_value() );
+
+      // The cursor is a position: erasing the row it names resumes at the row after it.
+      ct::listprovpaps_action( bank, active( bank ) ).send( provider, std::optional<ct::pap_cursor>(), 2u );
+      auto cursor = returned<ct::pap_page>().next;
+      EXPECT( cursor.has_value() && cursor->service_id == 7 );
+      ct::erasepap_action( bank, active( provider ) ).send( carol, provider, 7u, std::string() );
+      ct::listprovpaps_action( bank, active( bank ) ).send( provider, cursor, 2u );
+      page = returned<ct::pap_page>();
+      EXPECT_EQ( page.rows.size(), 1u );
+      EXPECT( page.rows[0].account == alice && page.rows[0].service_id == 8 );
+
+      ct::listaccpaps_action( bank, active( bank ) ).send( alice, std::optional<ct::pap_cursor>(), 10u );
+      page = returned<ct::pap_page>();
+      EXPECT_EQ( page.rows.size(), 2u );
+      EXPECT( page.rows[0].service_id == 7 && page.rows[1].service_id == 8 );
+
+      // listcusts starts at the cursor key itself.
+      ct::listcusts_action( bank, active( bank ) ).send( bob, 2u );
+      auto customers = returned<ct::customer_page>();
+      EXPECT_EQ( customers.rows.size(), 2u );
+      EXPECT( customers.rows[0].key == bob && customers.rows[1].key == carol );
+      EXPECT( customers.next == std::optional<name>( provider ) );
+      EXPECT_EQ( pap_rows(), 3u );
+   }
+
+   void test_upsertcusts() {
+      for( auto n : { alice, bob } )
+         native::chain::get().create_account( n );
+      customer( carol, 0, 0, ct::TYPE_ACCOUNT_PERSONAL );
+
+      // New rows and updates in one action, applied in order.
+      ct::upsertcusts_action( bank, active( bank ) ).send( std::vector<ct::customer_record>{
+         { alice, asset( 5000, token ), ink( 10 ), ct::TYPE_ACCOUNT_PERSONAL, ct::STATE_ENABLED },
+         { bob, ink( 0 ), ink( 0 ), ct::TYPE_ACCOUNT_PERSONAL, ct::STATE_ENABLED },
+         { carol, ink( 0 ), ink( 0 ), ct::TYPE_ACCOUNT_PERSONAL, ct::STATE_BLOCKED },
+         { bob, ink( 0 ), ink( 20 ), ct::TYPE_ACCOUNT_PERSONAL, ct::STATE_ENABLED } } );
+      EXPECT_FAIL( ct::upsertcusts_action( bank, active( alice ) ).send( std::vector<ct::customer_record>{
+         { alice, ink( 0 ), ink( 0 ), ct::TYPE_ACCOUNT_PERSONAL, ct::STATE_ENABLED } } ) );
+
+      ct::listcusts_action( bank, active( bank ) ).send( name(), 10u );
+      auto page = returned<ct::customer_page>();
+      EXPECT_EQ( page.rows.size(), 4u );
+      EXPECT( page.rows[0].key == alice && page.rows[0].fee == asset( 5000, token ) );
+      EXPECT( page.rows[1].key == bob && page.rows[1].overdraft == ink( 20 ) );
+      EXPECT( page.rows[2].key == carol && page.rows[2].state == ct::STATE_BLOCKED );
+
+      // Credit lines are granted without issuing tokens.
+      ct::transfer_action( bank, active( bob ) ).send( bob, alice, ink( 20 ), std::string() );
+      EXPECT_EQ( balance( bob ), ink( -20 ) );
+      EXPECT_EQ( supply(), ink( 0 ) );
+   }
+
+}
+
+int main( int argc, char** argv ) {
+   const std::vector<std::pair<const char*, void(*)()>> tests = {
+      { "transfer",       test_transfer },
+      { "xfer",           test_xfer },
+      { "issue",          test_issue },
+      { "transfer_fees",  test_transfer_fees },
+      { "chargepap",      test_chargepap },
+      { "bydue",          test_bydue },
+      { "catchuppap",     test_catchuppap },
+      { "chargeall",      test_chargeall },
+      { "overdraft",      test_overdraft },
+      { "migratecusts",   test_migratecusts },
+      { "migratepaps",    test_migratepaps },
+      { "prunepaps",      test_prunepaps },
+      { "audit",          test_audit },
+      { "setnotify",      test_setnotify },
+      { "results",        test_results },
+      { "queries",        test_queries },
+      { "upsertcusts",    test_upsertcusts },
+   };
+
+   int failed = 0;
+   for( const auto& [name, run] : tests ) {
+      bool selected = argc == 1;
+      for( int i = 1; i < argc; ++i )
+         selected |= std::strcmp( argv[i], name ) == 0;
+      if( !selected )
+         continue;
+
+      std::string error;
+      try {
+         setup();
+         run();
+      } catch( const test_failure& e ) {
+         error = e.message;
+      } catch( const native::assertion_failure& e ) {
+         error = std::string( "action failed: " ) + e.what();
+      } catch( const std::exception& e ) {
+         error = e.what();
+      }
+      std::printf( "%-16s %s%s\n", name, error.empty() ? "ok" : "FAIL ", error.c_str() );
+      failed += !error.empty();
+   }
+   return failed ? 1 : 0;
+}
@@ -0,0 +1,272 @@
+// Fork test of cristaltoken_indexer.
+//
+// Writes a state history log of a few blocks of contract_row deltas, runs the indexer on
+// it with --follow and queries it over its socket while the log tail is rewritten as
+// nodeos does on a fork switch: truncated at the first replaced block and followed by the
+// new branch. Forks within the undo window must only undo the replaced blocks; a rewrite
+// of the first block must rebuild the state from the start of the log.
+//
+//    cristaltoken_indexer_tests <cristaltoken_indexer> <work directory>
+
+#include <cristaltoken.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <zlib.h>
+
+using namespace eosio;
+
+namespace {
+
+   const symbol  token( "INK", 4 );
+   const name    bank     = "bank"_n;
+   const name    alice    = "alice"_n;
+   const name    bob      = "bob"_n;
+   const name    provider = "provider"_n;
+
+   // Little endian packing of the log entries and their rows.
+   struct packer {
+      std::string out;
+
+      template<typename T>
+      packer& operator<<( const T& v ) {
+         out.append( reinterpret_cast<const char*>( &v ), sizeof( v ) );
+         return *this;
+      }
+      packer& operator<<( name n ) { return *this << n.value; }
+      packer& operator<<( const asset& a ) { return *this << a.amount << a.symbol.raw(); }
+      packer& operator<<( const std::string& s ) { varuint( s.size() ); out += s; return *this; }
+
+      packer& varuint( uint64_t v ) {
+         do {
+            uint8_t b = v & 0x7f;
+            v >>= 7;
+            out += char( v ? b | 0x80 : b );
+         } while( v );
+         return *this;
+      }
+   };
+
+   // One contract_row delta of the contract.
+   struct delta {
+      bool         present;
+      name         table;
+      uint64_t     scope;
+      uint64_t     primary_key;
+      std::string  value;
+   };
+
+   delta balance( name owner, int64_t units ) {
+      packer p;
+      p << asset( units * 10000, token );
+      return { true, "accounts"_n, owner.value, token.code().raw(), p.out };
+   }
+
+   delta pap( uint64_t id, name account, uint16_t last_charged ) {
+      packer p;
+      p << id << account << provider << uint32_t( 1 ) << uint8_t( 0 ) << asset( 50000, token ) << uint32_t( 1600000000 )
+        << uint16_t( 12 ) << last_charged << cristaltoken::PAP_FLAG_ENABLED << uint32_t( 0 );
+      return { true, "paps"_n, bank.value, id, p.out };
+   }
+
+   // Appends the entry of `block` to the log; `branch` tells the block ids of forks apart.
+   void write_entry( std::fstream& log, uint32_t block, char branch, const std::vector<delta>& deltas ) {
+      packer d;
+      d.varuint( 1 ) << uint8_t( 0 ) << std::string( "contract_row" );
+      d.varuint( deltas.size() );
+      for( const auto& r : deltas ) {
+         packer row;
+         row.varuint( 0 ) << bank << r.scope << r.table << r.primary_key << bank;
+         row.varuint( r.value.size() );
+         row.out += r.value;
+         d << r.present;
+         d.varuint( row.out.size() );
+         d.out += row.out;
+      }
+
+      std::vector<char> compressed( compressBound( d.out.size() ) );
+      uLongf size = compressed.size();
+      if( compress( reinterpret_cast<Bytef*>( compressed.data() ), &size, reinterpret_cast<const Bytef*>( d.out.data() ), d.out.size() ) != Z_OK )
+         throw std::runtime_error( "cannot compress entry" );
+
+      log.seekp( 0, std::ios::end );
+      uint64_t position = log.tellp();
+      packer e;
+      e << ( "ship"_n.value & 0xffff'ffff'0000'0000ull );
+      e << uint8_t( block >> 24 ) << uint8_t( block >> 16 ) << uint8_t( block >> 8 ) << uint8_t( block );
+      e.out.append( 28, branch );
+      e << uint64_t( 4 + size ) << uint32_t( size );
+      e.out.append( compressed.data(), size );
+      e << position;
+      log.write( e.out.data(), e.out.size() );
+      log.flush();
+   }
+
+   // Offsets of the entries of the log, in order.
+   std::vector<uint64_t> entry_offsets( const std::filesystem::path& path ) {
+      std::ifstream in( path, std::ios::binary );
+      std::string data( ( std::istreambuf_iterator<char>( in ) ), std::istreambuf_iterator<char>() );
+      std::vector<uint64_t> offsets;
+      for( uint64_t pos = 0; pos + 48 <= data.size(); ) {
+         uint64_t payload_size;
+         std::memcpy( &payload_size, data.data() + pos + 40, 8 );
+         offsets.push_back( pos );
+         pos += 48 + payload_size + 8;
+      }
+      return offsets;
+   }
+
+   // Drops the entries of the log from its `index`th on, as nodeos does on a fork switch.
+   void truncate_log( const std::filesystem::path& path, std::size_t index ) {
+      std::filesystem::resize_file( path, entry_offsets( path ).at( index ) );
+   }
+
+   class indexer_process {
+      public:
+         indexer_process( const char* indexer, const std::filesystem::path& log, const std::filesystem::path& socket,
+                          const std::filesystem::path& err ) : _socket( socket ), _err( err ) {
+            _pid = ::fork();
+            if( _pid == 0 ) {
+               int fd = ::open( err.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+               ::dup2( fd, 2 );
+               ::execl( indexer, indexer, log.c_str(), "bank", socket.c_str(), "--follow", (char*)nullptr );
+               ::_exit( 127 );
+            }
+            if( _pid < 0 ) throw std::runtime_error( "cannot start the indexer" );
+         }
+         ~indexer_process() {
+            ::kill( _pid, SIGTERM );
+            ::waitpid( _pid, nullptr, 0 );
+         }
+
+         // Answer of one request, or an empty string if the indexer cannot be reached.
+         std::string query( const std::string& request ) const {
+            int fd = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::strncpy( addr.sun_path, _socket.c_str(), sizeof( addr.sun_path ) - 1 );
+            timeval timeout{ 2, 0 };
+            ::setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+            std::string answer;
+            if( ::connect( fd, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) == 0 ) {
+               std::string line = request + "\n";
+               ::send( fd, line.data(), line.size(), MSG_NOSIGNAL );
+               // The answer ends with an empty line, and is only that line when empty.
+               auto complete = [&] { return answer == "\n" || answer.ends_with( "\n\n" ); };
+               char buf[4096];
+               ssize_t n;
+               while( !complete() && ( n = ::recv( fd, buf, sizeof( buf ), 0 ) ) > 0 )
+                  answer.append( buf, n );
+            }
+            ::close( fd );
+            return answer;
+         }
+
+         // Waits until `request` is answered with `expected`; false after 10 seconds.
+         bool wait_for( const std::string& request, const std::string& expected ) const {
+            for( int i = 0; i < 200; ++i ) {
+               if( query( request ) == expected ) return true;
+               std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+            }
+            std::fprintf( stderr, "%s: expected \"%s\", got \"%s\"\n", request.c_str(), expected.c_str(), query( request ).c_str() );
+            return false;
+         }
+
+         std::string errors() const {
+            std::ifstream in( _err );
+            return std::string( ( std::istreambuf_iterator<char>( in ) ), std::istreambuf_iterator<char>() );
+         }
+
+      private:
+         pid_t                  _pid = -1;
+         std::filesystem::path  _socket;
+         std::filesystem::path  _err;
+   };
+
+   std::string status( uint32_t block, uint32_t accounts ) {
+      return "block=" + std::to_string( block ) + " accounts=" + std::to_string( accounts )
+           + " stat=0 customers=0 paps=1 due=1\n\n";
+   }
+
+   std::string balance_of( int64_t units ) { return asset( units * 10000, token ).to_string() + "\n\n"; }
+
+   std::string last_charged( uint16_t periods ) {
+      return "1,alice,provider,1,5.0000 INK,1600000000,12," + std::to_string( periods ) + ",1,"
+           + std::to_string( 1600000000 + ( periods + 1 ) * cristaltoken::REQUIRED_PERIOD_DURATION ) + "\n\n";
+   }
+
+   bool check_step( bool ok, const char* step ) {
+      std::printf( "%-40s %s\n", step, ok ? "ok" : "FAIL" );
+      return ok;
+   }
+
+}
+
+int main( int argc, char** argv ) {
+   if( argc != 3 ) {
+      std::fprintf( stderr, "usage: %s <cristaltoken_indexer> <work directory>\n", argv[0] );
+      return 2;
+   }
+   try {
+      std::filesystem::path dir( argv[2] );
+      std::filesystem::create_directories( dir );
+      auto path = dir / "chain_state_history.log";
+      { std::ofstream create( path, std::ios::binary | std::ios::trunc ); }
+      std::fstream log( path, std::ios::binary | std::ios::in | std::ios::out );
+
+      write_entry( log, 100, 'a', { balance( alice, 100 ), pap( 1, alice, 0 ) } );
+      write_entry( log, 101, 'a', { balance( alice, 90 ), balance( bob, 10 ) } );
+      write_entry( log, 102, 'a', { balance( alice, 80 ), balance( bob, 20 ), pap( 1, alice, 1 ) } );
+
+      indexer_process indexer( argv[1], path, dir / "indexer.sock", dir / "indexer.err" );
+      bool ok = check_step( indexer.wait_for( "status", status( 102, 2 ) ), "initial load" );
+      ok &= check_step( indexer.query( "paps alice" ) == last_charged( 1 ), "initial pap" );
+
+      // Fork at 102: the log is truncated there and the new branch appended.
+      log.close();
+      truncate_log( path, 2 );
+      log.open( path, std::ios::binary | std::ios::in | std::ios::out );
+      write_entry( log, 102, 'b', { balance( alice, 70 ), balance( bob, 30 ) } );
+      write_entry( log, 103, 'b', { balance( alice, 60 ), balance( bob, 40 ) } );
+      ok &= check_step( indexer.wait_for( "status", status( 103, 2 ) ), "fork at 102" );
+      ok &= check_step( indexer.query( "balance alice" ) == balance_of( 60 ), "fork balance" );
+      ok &= check_step( indexer.query( "paps alice" ) == last_charged( 0 ), "fork reverts the pap of 102a" );
+
+      // A block that does not follow the last one applied replaces it and the ones after.
+      write_entry( log, 102, 'c', { balance( bob, 5 ) } );
+      ok &= check_step( indexer.wait_for( "balance bob", balance_of( 5 ) ), "non increasing block" );
+      ok &= check_step( indexer.query( "balance alice" ) == balance_of( 90 ), "non increasing block reverts 102b" );
+      ok &= check_step( indexer.query( "status" ) == status( 102, 2 ), "non increasing block status" );
+
+      ok &= check_step( indexer.errors().find( "rebuilding" ) == std::string::npos, "no rebuild within the undo window" );
+
+      // A rewrite of the first block cannot be undone: the state is read again.
+      log.close();
+      truncate_log( path, 0 );
+      log.open( path, std::ios::binary | std::ios::in | std::ios::out );
+      write_entry( log, 100, 'd', { balance( bob, 1 ), pap( 1, alice, 2 ) } );
+      ok &= check_step( indexer.wait_for( "status", status( 100, 1 ) ), "rewritten first block" );
+      ok &= check_step( indexer.query( "balance alice" ) == "\n", "rebuilt balances" );
+      ok &= check_step( indexer.query( "paps alice" ) == last_charged( 2 ), "rebuilt pap" );
+      ok &= check_step( indexer.errors().find( "rebuilding" ) != std::string::npos, "rebuild reported" );
+      return ok ? 0 : 1;
+   } catch( const std::exception& e ) {
+      std::fprintf( stderr, "error: %s\n", e.what() );
+      return 1;
+   }
+}
@@ -0,0 +1,261 @@
+// Replay test of cristaltoken_planner.
+//
+// Fills the native chain with customers of varied balances, fees, credit lines and states,
+// and with about 6000 PAPs of two providers at different points of their periods, writes
+// the contract tables as the CSV files of cristaltoken_tabledump, runs the planner on them
+// and pushes the charges of every planned transaction. It fails if a planned charge fails,
+// or if a PAP is still chargeable once every transaction has been pushed.
+//
+//    cristaltoken_planner_tests <cristaltoken_planner> <work directory>
+
+#include <cristaltoken.hpp>
+#include <eosio/native/chain.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace eosio;
+using ct = cristaltoken;
+
+namespace {
+
+   constexpr uint32_t start_time = 1600000000;
+   constexpr uint32_t period     = ct::REQUIRED_PERIOD_DURATION;
+   constexpr int      customers  = 3000;
+   const symbol       token( "INK", 4 );
+   const name         bank = "bank"_n;
+   const name         providers[] = { "prova"_n, "provb"_n };
+
+   asset ink( int64_t units ) { return asset( units * 10000, token ); }
+
+   permission_level active( name n ) { return { n, "active"_n }; }
+
+   // Distinct account names c..., from the index in base 26.
+   name account( int i ) {
+      std::string s = "c";
+      do { s += char( 'a' + i % 26 ); i /= 26; } while( i );
+      return name( s );
+   }
+
+   decltype( ct::pap_page::rows ) all_paps() {
+      decltype( ct::pap_page::rows ) rows;
+      for( auto provider : providers ) {
+         std::optional<ct::pap_cursor> cursor;
+         do {
+            ct::listprovpaps_action( bank, active( bank ) ).send( provider, cursor, ct::MAX_QUERY_ROWS );
+            auto page = std::any_cast<ct::pap_page>( native::chain::get().traces().front().return_value );
+            rows.insert( rows.end(), page.rows.begin(), page.rows.end() );
+            cursor = page.next;
+         } while( cursor );
+      }
+      return rows;
+   }
+
+   void fill_chain() {
+      auto& chain = native::chain::get();
+      chain.set_time( time_point_sec( start_time ) );
+      chain.create_account( bank );
+      ct::create_action( bank, active( bank ) ).send( bank, ink( 1000000000 ) );
+      for( auto provider : providers ) {
+         chain.create_account( provider );
+         ct::upsertcust_action( bank, active( bank ) ).send( provider, ink( 0 ), ink( 0 ), ct::TYPE_ACCOUNT_BUSINESS,
+                                                             ct::STATE_ENABLED, std::string() );
+      }
+
+      // Some customers pay a fee, some have a credit line, some have no balance at all.
+      std::vector<ct::customer_record> records;
+      for( int i = 0; i < customers; ++i ) {
+         chain.create_account( account( i ) );
+         records.push_back( { account( i ), asset( i % 4 == 0 ? 5000 : 0, token ), ink( i % 5 == 0 ? 3 : 0 ),
+                              ct::TYPE_ACCOUNT_PERSONAL, ct::STATE_ENABLED } );
+      }
+      ct::upsertcusts_action( bank, active( bank ) ).send( records );
+
+      // One to three PAPs each, begun up to five periods ago, a few of them blocked.
+      for( int i = 0; i < customers; ++i ) {
+         if( i % 7 && i % 13 )
+            ct::issue_action( bank, active( bank ) ).send( account( i ), asset( 10000 * ( i % 13 ), token ), std::string() );
+         for( int k = 0; k < 1 + i % 3; ++k ) {
+            uint32_t begins_at = start_time - ( i % 6 ) * period - ( i % 11 ) * 3600;
+            ct::upsertpap_action( bank, active( account( i ) ) ).send( account( i ), providers[k % 2], uint32_t( k ), ink( 1 + k ),
+                                                                      begins_at, uint32_t( 3 + i % 5 ), 0u,
+                                                                      i % 19 == 0 ? ct::STATE_BLOCKED : ct::STATE_ENABLED,
+                                                                      std::string() );
+         }
+      }
+
+      // Blocked customers are not charged.
+      for( int i = 0; i < customers; i += 17 )
+         ct::upsertcust_action( bank, active( bank ) ).send( account( i ), asset( i % 4 == 0 ? 5000 : 0, token ),
+                                                             ink( i % 5 == 0 ? 3 : 0 ), ct::TYPE_ACCOUNT_PERSONAL,
+                                                             ct::STATE_BLOCKED, std::string() );
+      chain.produce( period / 2 );
+   }
+
+   // accounts.csv, customers.csv and paps.csv as cristaltoken_tabledump writes them.
+   void write_csv( const std::filesystem::path& dir ) {
+      std::ofstream accounts( dir / "accounts.csv" );
+      accounts << "owner,balance\n";
+      for( int i = 0; i < customers; ++i ) {
+         multi_index<"accounts"_n, ct::account_row> rows( bank, account( i ).value );
+         for( const auto& row : rows )
+            accounts << account( i ).to_string() << ',' << row.balance.to_string() << '\n';
+      }
+
+      std::ofstream customers_csv( dir / "customers.csv" );
+      customers_csv << "scope,key,layout,fee,overdraft,account_type,state,flags\n";
+      multi_index<"customers"_n, ct::customer_row> rows( bank, bank.value );
+      for( const auto& row : rows ) {
+         auto c = row.view( token );
+         customers_csv << "bank," << c.key.to_string() << ',' << row.data.index() << ',' << c.fee.to_string() << ','
+                       << c.overdraft.to_string() << ',' << c.account_type << ',' << c.state << ',' << int( c.flags ) << '\n';
+      }
+
+      std::ofstream paps( dir / "paps.csv" );
+      paps << "scope,id,layout,account,provider,service_id,price,begins_at,periods,last_charged,flags,disabled_at\n";
+      ct::pap_table pap_rows( bank, bank.value );
+      for( const auto& row : pap_rows ) {
+         auto p = row.view();
+         paps << "bank," << p.id << ',' << row.data.index() << ',' << p.account.to_string() << ',' << p.provider.to_string() << ','
+              << p.service_id << ','
+              << p.price.to_string() << ',' << p.begins_at.sec_since_epoch() << ',' << p.periods << ',' << p.last_charged << ','
+              << int( p.flags ) << ',' << p.disabled_at.sec_since_epoch() << '\n';
+      }
+   }
+
+   // Reader of the planner output: transactions prefixed by their size.
+   struct reader {
+      const std::string& data;
+      std::size_t        pos = 0;
+
+      template<typename T>
+      T read() {
+         T v;
+         check( pos + sizeof( v ) <= data.size(), "truncated planner output" );
+         std::memcpy( &v, data.data() + pos, sizeof( v ) );
+         pos += sizeof( v );
+         return v;
+      }
+
+      uint64_t varuint() {
+         uint64_t v = 0;
+         uint8_t  b;
+         int      shift = 0;
+         do {
+            b = read<uint8_t>();
+            v |= uint64_t( b & 0x7f ) << shift;
+            shift += 7;
+         } while( b & 0x80 );
+         return v;
+      }
+   };
+
+   struct replay_stats {
+      uint64_t  transactions = 0;
+      uint64_t  ok = 0;
+      uint64_t  failed = 0;
+   };
+
+   replay_stats replay( const std::filesystem::path& file ) {
+      std::ifstream in( file, std::ios::binary );
+      std::string data( ( std::istreambuf_iterator<char>( in ) ), std::istreambuf_iterator<char>() );
+      reader r{ data };
+      replay_stats stats;
+      while( r.pos < data.size() ) {
+         auto size = r.read<uint32_t>();
+         auto end = r.pos + size;
+         ++stats.transactions;
+         r.read<uint32_t>(); r.read<uint16_t>(); r.read<uint32_t>();  // expiration, TaPoS
+         r.varuint(); r.read<uint8_t>(); r.varuint();                   // net, cpu, delay
+         check( r.varuint() == 0, "context free actions in planner output" );
+         auto actions = r.varuint();
+         name signer;
+         for( uint64_t a = 0; a < actions; ++a ) {
+            check( name( r.read<uint64_t>() ) == bank, "charge of another contract" );
+            name act( r.read<uint64_t>() );
+            check( r.varuint() == 1, "charge with several authorizations" );
+            name actor( r.read<uint64_t>() );
+            r.read<uint64_t>();                                          // permission
+            check( a == 0 || actor == signer, "transaction with several signers" );
+            signer = actor;
+
+            auto data_size = r.varuint();
+            auto data_end = r.pos + data_size;
+            name     from( r.read<uint64_t>() );
+            name     to( r.read<uint64_t>() );
+            auto     service_id = r.read<uint32_t>();
+            auto     amount = r.read<int64_t>();
+            symbol   sym( r.read<uint64_t>() );
+            uint32_t periods = act == "catchuppap"_n ? r.read<uint32_t>() : 1;
+            std::string memo( r.varuint(), '\0' );
+            for( auto& c : memo ) c = r.read<char>();
+            check( r.pos == data_end, "bad action data length" );
+
+            try {
+               if( act == "catchuppap"_n )
+                  ct::catchuppap_action( bank, active( actor ) ).send( from, to, service_id, asset( amount, sym ), periods, memo );
+               else
+                  ct::chargepap_action( bank, active( actor ) ).send( from, to, service_id, asset( amount, sym ), memo );
+               ++stats.ok;
+            } catch( const native::assertion_failure& e ) {
+               if( ++stats.failed <= 5 )
+                  std::fprintf( stderr, "planned charge of %s failed: %s\n", from.to_string().c_str(), e.what() );
+            }
+         }
+         r.varuint();                                                    // transaction_extensions
+         check( r.pos == end, "bad transaction length" );
+      }
+      return stats;
+   }
+
+   // PAPs that can still be charged once the plan has been pushed.
+   uint64_t missed() {
+      uint64_t count = 0;
+      for( const auto& p : all_paps() ) {
+         try {
+            ct::chargepap_action( bank, active( bank ) ).send( p.account, p.provider, p.service_id, p.price, std::string() );
+            if( ++count <= 5 )
+               std::fprintf( stderr, "not planned: %s\n", p.account.to_string().c_str() );
+         } catch( const native::assertion_failure& ) {}
+      }
+      return count;
+   }
+
+}
+
+int main( int argc, char** argv ) {
+   if( argc != 3 ) {
+      std::fprintf( stderr, "usage: %s <cristaltoken_planner> <work directory>\n", argv[0] );
+      return 2;
+   }
+   try {
+      std::filesystem::path dir( argv[2] );
+      std::filesystem::create_directories( dir );
+      fill_chain();
+      write_csv( dir );
+
+      auto plan = dir / "charges.bin";
+      std::string command = std::string( "\"" ) + argv[1] + "\" \"" + dir.string() + "\" bank \"" + plan.string()
+                          + "\" --per-tx 40 --threads 4 --at " + std::to_string( native::chain::get().now().sec_since_epoch() );
+      if( std::system( command.c_str() ) != 0 ) {
+         std::fprintf( stderr, "planner failed: %s\n", command.c_str() );
+         return 1;
+      }
+
+      auto stats = replay( plan );
+      auto left = missed();
+      std::printf( "transactions=%llu ok=%llu failed=%llu missed=%llu\n", (unsigned long long)stats.transactions,
+                   (unsigned long long)stats.ok, (unsigned long long)stats.failed, (unsigned long long)left );
+      return stats.ok > 0 && stats.failed == 0 && left == 0 ? 0 : 1;
+   } catch( const std::exception& e ) {
+      std::fprintf( stderr, "error: %s\n", e.what() );
+      return 1;
+   }
+}
@@ -0,0 +1,227 @@
+// Per action cost of the hot paths as the tables grow.
+//
+// For every table size N the native chain is filled with N token holders, all of them
+// customers with a PAP to the same provider (so one `paps` scope of N rows), then
+// `transfer`, `issue`, `upsertpap` and `chargepap` are each pushed `runs` times and
+// their table operations and estimated RAM delta (see include/profile.hpp) are summed,
+// inline actions included.
+// Host time per action is reported as an indication of CPU only: it is not billed CPU
+// and varies between machines, so only the counters are compared with the baseline.
+//
+//    cristaltoken_bench [--baseline <file>] [--write-baseline <file>] [N ...]
+//
+// With --baseline any counter that differs from the file fails the run (exit status 1).
+// The default sizes are the ones of the checked-in baseline, tools/bench_baseline.txt.
+
+#include <cristaltoken.hpp>
+#include <eosio/native/chain.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef CRISTALTOKEN_PROFILE
+#error "cristaltoken_bench needs the profiling build (-DCRISTALTOKEN_PROFILE=ON)"
+#endif
+
+using namespace eosio;
+using ct = cristaltoken;
+
+namespace {
+
+   constexpr uint32_t runs        = 100;
+   constexpr uint32_t start_time  = 1600000000;
+   const symbol       token( "INK", 4 );
+   const name         bank     = "bank"_n;
+   const name         provider  = "provider"_n;
+   const name         provider2 = "provider2"_n;
+
+   // Distinct account names u..., from the index in base 31 (letters and 1-5).
+   name holder( uint64_t i ) {
+      static const char digits[] = "abcdefghijklmnopqrstuvwxyz12345";
+      char buf[13] = "u";
+      int n = 1;
+      do { buf[n++] = digits[i % 31]; i /= 31; } while( i && n < 12 );
+      return name( std::string_view( buf, n ) );
+   }
+
+   asset ink( int64_t units ) { return asset( units * 10000, token ); }
+
+   struct result {
+      profile::counters  total{};
+      double             us_per_action = 0;
+
+      std::string counters_text()const {
+         std::ostringstream out;
+         out << "find=" << total.find << " store=" << total.store << " update=" << total.update
+             << " remove=" << total.remove << " idx_find=" << total.idx_find << " idx_store=" << total.idx_store
+             << " idx_update=" << total.idx_update << " idx_remove=" << total.idx_remove << " ram=" << total.ram;
+         return out.str();
+      }
+   };
+
+   void add( profile::counters& total, const profile::counters& c ) {
+      total.find += c.find;         total.store += c.store;
+      total.update += c.update;     total.remove += c.remove;
+      total.idx_find += c.idx_find; total.idx_store += c.idx_store;
+      total.idx_update += c.idx_update; total.idx_remove += c.idx_remove;
+      total.ram += c.ram;
+   }
+
+   // Counters of every action of the last transaction, read back from the profile lines
+   // the actions print to the console (the counters themselves restart with each action).
+   profile::counters transaction_counters() {
+      profile::counters total{};
+      std::istringstream console( native::chain::get().console() );
+      std::string line;
+      while( std::getline( console, line ) ) {
+         profile::counters c{};
+         long long ram = 0;
+         if( std::sscanf( line.c_str(), "profile: find=%u store=%u update=%u remove=%u idx_find=%u idx_store=%u idx_update=%u idx_remove=%u ram=%lld",
+                          &c.find, &c.store, &c.update, &c.remove, &c.idx_find, &c.idx_store, &c.idx_update, &c.idx_remove, &ram ) != 9 )
+            continue;
+         c.ram = ram;
+         add( total, c );
+      }
+      return total;
+   }
+
+   // Pushes `push(i)` for i in [0, runs) and sums the counters each transaction leaves behind.
+   template<typename Push>
+   result measure( Push&& push ) {
+      result r;
+      std::chrono::nanoseconds elapsed{0};
+      for( uint32_t i = 0; i < runs; ++i ) {
+         auto start = std::chrono::steady_clock::now();
+         push( i );
+         elapsed += std::chrono::steady_clock::now() - start;
+         add( r.total, transaction_counters() );
+      }
+      r.us_per_action = elapsed.count() / 1000.0 / runs;
+      return r;
+   }
+
+   void populate( uint64_t size ) {
+      auto& chain = native::chain::get();
+      chain.reset();
+      chain.set_time( time_point_sec( start_time ) );
+      for( auto n : { bank, provider, provider2 } ) chain.create_account( n );
+
+      ct::create_action{ bank, {bank, "active"_n} }.send( bank, ink( 1000000000 ) );
+      ct::upsertcust_action{ bank, {bank, "active"_n} }.send( provider, ink( 0 ), ink( 0 ), ct::TYPE_ACCOUNT_BUSINESS, ct::STATE_ENABLED, std::string() );
+      ct::upsertcust_action{ bank, {bank, "active"_n} }.send( provider2, ink( 0 ), ink( 0 ), ct::TYPE_ACCOUNT_BUSINESS, ct::STATE_ENABLED, std::string() );
+
+      const asset fee( 1, token );
+      for( uint64_t i = 0; i < size; ++i ) {
+         auto h = holder( i );
+         chain.create_account( h );
+         ct::upsertcust_action{ bank, {bank, "active"_n} }.send( h, fee, ink( 0 ), ct::TYPE_ACCOUNT_PERSONAL, ct::STATE_ENABLED, std::string() );
+         ct::issue_action{ bank, {bank, "active"_n} }.send( h, ink( 100 ), std::string() );
+         ct::upsertpap_action{ bank, {h, "active"_n} }.send( h, provider, 1u, ink( 1 ), start_time, 12u, 0u, ct::STATE_ENABLED, std::string() );
+      }
+      // Every PAP is due for its first period.
+      chain.produce( ct::REQUIRED_PERIOD_DURATION );
+   }
+
+   std::map<std::string, result> run( uint64_t size ) {
+      populate( size );
+      std::map<std::string, result> results;
+      results["transfer"] = measure( [&]( uint32_t i ) {
+         auto from = holder( i % size ), to = holder( (i + 1) % size );
+         ct::transfer_action{ bank, {from, "active"_n} }.send( from, to, ink( 1 ), std::string() );
+      });
+      results["issue"] = measure( [&]( uint32_t i ) {
+         ct::issue_action{ bank, {bank, "active"_n} }.send( holder( i % size ), ink( 1 ), std::string() );
+      });
+      results["upsertpap"] = measure( [&]( uint32_t i ) {
+         auto h = holder( i % size );
+         ct::upsertpap_action{ bank, {h, "active"_n} }.send( h, provider2, i, ink( 1 ), start_time, 12u, 0u, ct::STATE_ENABLED, std::string() );
+      });
+      results["chargepap"] = measure( [&]( uint32_t i ) {
+         ct::chargepap_action{ bank, {provider, "active"_n} }.send( holder( i % size ), provider, 1u, ink( 1 ), std::string() );
+      });
+      return results;
+   }
+
+   // "<action> <size> <counters>" lines; '#' starts a comment.
+   std::map<std::string, std::string> read_baseline( const char* path ) {
+      std::map<std::string, std::string> baseline;
+      std::ifstream in( path );
+      check( in.good(), "cannot read baseline file" );
+      std::string line;
+      while( std::getline( in, line ) ) {
+         if( line.empty() || line[0] == '#' ) continue;
+         std::istringstream fields( line );
+         std::string action, size, counters;
+         fields >> action >> size;
+         std::getline( fields >> std::ws, counters );
+         baseline[action + " " + size] = counters;
+      }
+      return baseline;
+   }
+
+} /// namespace
+
+int main( int argc, char** argv ) {
+   const char* baseline_path = nullptr;
+   const char* write_path = nullptr;
+   std::vector<uint64_t> sizes;
+   for( int i = 1; i < argc; ++i ) {
+      if( std::strcmp( argv[i], "--baseline" ) == 0 && i + 1 < argc ) baseline_path = argv[++i];
+      else if( std::strcmp( argv[i], "--write-baseline" ) == 0 && i + 1 < argc ) write_path = argv[++i];
+      else if( argv[i][0] != '-' ) sizes.push_back( std::stoull( argv[i] ) );
+      else {
+         std::fprintf( stderr, "usage: %s [--baseline <file>] [--write-baseline <file>] [N ...]\n", argv[0] );
+         return 2;
+      }
+   }
+   if( sizes.empty() ) sizes = { 1000, 10000, 100000 };
+   for( auto size : sizes ) {
+      if( size < runs ) {
+         std::fprintf( stderr, "error: table sizes must be at least %u\n", runs );
+         return 2;
+      }
+   }
+
+   try {
+      std::map<std::string, std::string> baseline;
+      if( baseline_path ) baseline = read_baseline( baseline_path );
+
+      std::ostringstream written;
+      written << "# cristaltoken_bench: table operations and RAM summed over " << runs << " actions\n";
+      int regressions = 0;
+      std::printf( "%-10s %8s  %8s  %s\n", "action", "rows", "us/act", "counters (sum of runs)" );
+      for( auto size : sizes ) {
+         for( const auto& [action, r] : run( size ) ) {
+            auto key = action + " " + std::to_string( size );
+            auto text = r.counters_text();
+            std::printf( "%-10s %8llu  %8.2f  %s\n", action.c_str(), (unsigned long long)size, r.us_per_action, text.c_str() );
+            written << key << " " << text << "\n";
+
+            auto expected = baseline.find( key );
+            if( expected != baseline.end() && expected->second != text ) {
+               std::printf( "  REGRESSION? baseline: %s\n", expected->second.c_str() );
+               ++regressions;
+            }
+         }
+      }
+
+      if( write_path ) {
+         std::ofstream out( write_path );
+         out << written.str();
+      }
+      if( regressions ) {
+         std::printf( "%d result(s) differ from the baseline\n", regressions );
+         return 1;
+      }
+   } catch( const std::exception& e ) {
+      std::fprintf( stderr, "error: %s\n", e.what() );
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,590 @@
+// Companion indexer of the cristaltoken tables.
+//
+// Reads the state history log that nodeos writes with the state_history_plugin
+// (`chain_state_history.log`, table deltas only) and keeps the contract's balances, token
+// stats, customers and a due-ordered PAP schedule in memory. Queries are answered over a
+// local (unix domain) socket:
+//
+//    cristaltoken_indexer <chain_state_history.log> <contract account> <socket path> [--follow]
+//
+// With --follow the log is polled for new blocks. When nodeos rewrites its tail (fork
+// switch) the blocks it replaced are undone, up to the last `undo_blocks` ones; a deeper
+// rewrite rebuilds the state from the start of the log. The log must start where the
+// state history starts (`--state-history-dir` filled from genesis or a snapshot), since
+// its first entry holds every existing row.
+//
+// Only the `contract_row` deltas of the contract are decoded, in place into the contract's
+// own row types (cristaltoken::*_row); every other table and contract is skipped.
+//
+// Protocol: one request per line, the answer is zero or more lines and an empty line.
+//
+//    balance <owner>                   one asset per token held
+//    supply <SYM>                      supply,max_supply,issuer
+//    customer <name>                   key,fee,overdraft,account_type,state,flags
+//    paps <account>                    the account's PAPs
+//    due <unix seconds> [limit]        enabled PAPs chargeable at that time, by due time
+//    status                            last block and row counts
+//
+// PAPs are listed as id,account,provider,service_id,price,begins_at,periods,last_charged,
+// enabled,next_charge_at. Errors are answered as `error: <message>`.
+
+#include <cristaltoken.hpp>
+
+#include <charconv>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <zlib.h>
+
+using namespace eosio;
+
+namespace {
+
+   constexpr uint64_t ship_magic_mask     = 0xffff'ffff'0000'0000ull;
+   constexpr uint32_t ship_max_version    = 1;
+   constexpr int      follow_interval_ms  = 500;
+   // Blocks that can be undone on a fork switch. nodeos only rewrites the blocks after the
+   // last irreversible one, a few hundred behind the head.
+   constexpr uint32_t undo_blocks         = 1000;
+
+   using customer_view = decltype( std::declval<cristaltoken::legacy_customer_row>().view() );
+   using pap_view      = decltype( std::declval<cristaltoken::pap_row>().view() );
+
+   // Rows of the legacy and current tables are kept apart: a migrated row is erased from
+   // one and stored in the other by the same block, in no particular delta order.
+   struct pap_key {
+      uint64_t  id;
+      bool      legacy;
+      auto operator<=>( const pap_key& ) const = default;
+   };
+
+   pap_view from_legacy( const cristaltoken::legacy_pap_row& l ) {
+      pap_view p{};
+      p.id = l.id;  p.account = l.account;  p.provider = l.provider;  p.service_id = l.service_id;
+      p.price = l.price;  p.begins_at = l.begins_at;
+      p.periods = l.periods;  p.last_charged = l.last_charged;
+      p.flags = l.enabled == cristaltoken::STATE_ENABLED ? cristaltoken::PAP_FLAG_ENABLED : 0;
+      return p;
+   }
+
+   // In-memory copy of the contract tables.
+   //
+   // Every block after the first one applied records how to revert its deltas, as the
+   // native chain does for a transaction (see record_undo), so a fork switch only undoes
+   // the blocks it replaces. The first block holds every existing row and is not recorded.
+   class contract_state {
+      public:
+         explicit contract_state( name contract ) : _contract( contract ) {}
+
+         void clear() {
+            _balances.clear();  _stats.clear();  _customers.clear();  _legacy_customers.clear();
+            _paps.clear();  _schedule.clear();  _by_account.clear();
+            _frames.clear();
+            _token = symbol();
+            _block = 0;
+         }
+
+         // Starts applying the deltas of `block`.
+         void begin_block( uint32_t block ) {
+            if( _block != 0 ) {
+               _frames.push_back( { _block, {} } );
+               if( _frames.size() > undo_blocks ) _frames.pop_front();
+            }
+            _block = block;
+         }
+
+         // Reverts the last block applied; false if it cannot be undone (first block applied,
+         // or more than `undo_blocks` ago).
+         bool undo_block() {
+            if( _frames.empty() ) return false;
+            auto& frame = _frames.back();
+            for( auto it = frame.undo.rbegin(); it != frame.undo.rend(); ++it ) (*it)();
+            _block = frame.previous_block;
+            _frames.pop_back();
+            return true;
+         }
+
+         uint32_t block()const { return _block; }
+
+         // Applies one contract_row delta; `present` is false for removed rows.
+         void apply( name table, uint64_t scope, uint64_t primary_key, bool present, datastream<const char*>& value ) {
+            switch( table.value ) {
+               case "accounts"_n.value:
+                  record( _balances, { scope, primary_key } );
+                  if( present ) { value >> _account_row; _balances[{ scope, primary_key }] = _account_row.balance; }
+                  else _balances.erase( { scope, primary_key } );
+                  break;
+               case "stat"_n.value:
+                  record( _stats, primary_key );
+                  if( present ) { value >> _stats_row; _stats[primary_key] = _stats_row; }
+                  else _stats.erase( primary_key );
+                  break;
+               case "config"_n.value:
+                  if( scope != _contract.value || !present ) break;
+                  if( !_frames.empty() ) _frames.back().undo.push_back( [this, token = _token] { _token = token; } );
+                  value >> _config_row;
+                  _token = _config_row.token;
+                  break;
+               case "customers"_n.value:
+                  // Kept packed: the contract token may be set by a later delta of the same block.
+                  if( scope != _contract.value ) break;
+                  record( _customers, primary_key );
+                  if( present ) value >> _customers[primary_key];
+                  else _customers.erase( primary_key );
+                  break;
+               case "customer"_n.value:
+                  if( scope != _contract.value ) break;
+                  record( _legacy_customers, primary_key );
+                  if( present ) { value >> _legacy_customer_row; _legacy_customers[primary_key] = _legacy_customer_row.view(); }
+                  else _legacy_customers.erase( primary_key );
+                  break;
+               case "paps"_n.value:
+                  if( scope != _contract.value ) break;
+                  record_pap( { primary_key, false } );
+                  erase_pap( { primary_key, false } );
+                  if( present ) { value >> _pap_row; store_pap( { primary_key, false }, _pap_row.view() ); }
+                  break;
+               case "pap"_n.value:
+                  if( scope != _contract.value ) break;
+                  record_pap( { primary_key, true } );
+                  erase_pap( { primary_key, true } );
+                  if( present ) { value >> _legacy_pap_row; store_pap( { primary_key, true }, from_legacy( _legacy_pap_row ) ); }
+                  break;
+            }
+         }
+
+         // Answers one request line into `out` (see the protocol above).
+         void query( std::string_view line, std::string& out )const {
+            auto args = split( line );
+            if( args.empty() ) throw std::runtime_error( "empty request" );
+            const auto& cmd = args[0];
+
+            if( cmd == "balance" && args.size() == 2 ) {
+               auto owner = name( args[1] ).value;
+               for( auto it = _balances.lower_bound( { owner, 0 } ); it != _balances.end() && it->first.first == owner; ++it )
+                  out += it->second.to_string() + "\n";
+            }
+            else if( cmd == "supply" && args.size() == 2 ) {
+               auto it = _stats.find( symbol_code( args[1] ).raw() );
+               if( it != _stats.end() )
+                  out += it->second.supply.to_string() + "," + it->second.max_supply.to_string() + "," + it->second.issuer.to_string() + "\n";
+            }
+            else if( cmd == "customer" && args.size() == 2 ) {
+               auto key = name( args[1] ).value;
+               customer_view c;
+               if( auto it = _customers.find( key ); it != _customers.end() )
+                  c = it->second.view( _token );
+               else if( auto legacy = _legacy_customers.find( key ); legacy != _legacy_customers.end() )
+                  c = legacy->second;
+               else
+                  return;
+               out += c.key.to_string() + "," + c.fee.to_string() + "," + c.overdraft.to_string() + "," + std::to_string( c.account_type )
+                    + "," + std::to_string( c.state ) + "," + std::to_string( c.flags ) + "\n";
+            }
+            else if( cmd == "paps" && args.size() == 2 ) {
+               auto account = name( args[1] ).value;
+               for( auto it = _by_account.lower_bound( { account, {} } ); it != _by_account.end() && it->first == account; ++it )
+                  write_pap( _paps.at( it->second ), out );
+            }
+            else if( cmd == "due" && ( args.size() == 2 || args.size() == 3 ) ) {
+               auto at = number( args[1] );
+               auto limit = args.size() == 3 ? number( args[2] ) : std::numeric_limits<uint64_t>::max();
+               for( auto it = _schedule.begin(); it != _schedule.end() && std::get<0>( *it ) <= at && limit > 0; ++it, --limit )
+                  write_pap( _paps.at( { std::get<1>( *it ), std::get<2>( *it ) } ), out );
+            }
+            else if( cmd == "status" && args.size() == 1 ) {
+               out += "block=" + std::to_string( _block ) + " accounts=" + std::to_string( _balances.size() )
+                    + " stat=" + std::to_string( _stats.size() )
+                    + " customers=" + std::to_string( _customers.size() + _legacy_customers.size() )
+                    + " paps=" + std::to_string( _paps.size() ) + " due=" + std::to_string( _schedule.size() ) + "\n";
+            }
+            else throw std::runtime_error( "unknown request" );
+         }
+
+      private:
+         struct frame {
+            uint32_t                             previous_block;
+            std::vector<std::function<void()>>   undo;
+         };
+
+         // Records how to restore the row of `key` in `rows` as it is before this delta.
+         template<typename Map>
+         void record( Map& rows, const typename Map::key_type& key ) {
+            if( _frames.empty() ) return;
+            std::optional<typename Map::mapped_type> before;
+            if( auto it = rows.find( key ); it != rows.end() ) before = it->second;
+            _frames.back().undo.push_back( [&rows, key, before = std::move( before )] {
+               if( before ) rows[key] = *before;
+               else rows.erase( key );
+            });
+         }
+
+         // As record, for a PAP and its schedule and account index entries.
+         void record_pap( const pap_key& key ) {
+            if( _frames.empty() ) return;
+            std::optional<pap_view> before;
+            if( auto it = _paps.find( key ); it != _paps.end() ) before = it->second;
+            _frames.back().undo.push_back( [this, key, before = std::move( before )] {
+               erase_pap( key );
+               if( before ) store_pap( key, *before );
+            });
+         }
+
+         void store_pap( const pap_key& key, const pap_view& row ) {
+            _paps[key] = row;
+            _by_account.insert( { row.account.value, key } );
+            if( row.by_due() < cristaltoken::PAP_DUE_INACTIVE )
+               _schedule.insert( { row.by_due(), key.id, key.legacy } );
+         }
+
+         void erase_pap( const pap_key& key ) {
+            auto it = _paps.find( key );
+            if( it == _paps.end() ) return;
+            _by_account.erase( { it->second.account.value, key } );
+            _schedule.erase( { it->second.by_due(), key.id, key.legacy } );
+            _paps.erase( it );
+         }
+
+         static void write_pap( const pap_view& p, std::string& out ) {
+            out += std::to_string( p.id ) + "," + p.account.to_string() + "," + p.provider.to_string() + ","
+                 + std::to_string( p.service_id ) + "," + p.price.to_string() + "," + std::to_string( p.begins_at.sec_since_epoch() )
+                 + "," + std::to_string( p.periods ) + "," + std::to_string( p.last_charged ) + ","
+                 + ( p.enabled() ? "1" : "0" ) + "," + std::to_string( p.next_charge_at() ) + "\n";
+         }
+
+         static std::vector<std::string_view> split( std::string_view line ) {
+            std::vector<std::string_view> args;
+            while( !line.empty() ) {
+               auto start = line.find_first_not_of( " \t\r" );
+               if( start == line.npos ) break;
+               line.remove_prefix( start );
+               auto end = std::min( line.find_first_of( " \t\r" ), line.size() );
+               args.push_back( line.substr( 0, end ) );
+               line.remove_prefix( end );
+            }
+            return args;
+         }
+
+         static uint64_t number( std::string_view s ) {
+            uint64_t v = 0;
+            auto [end, ec] = std::from_chars( s.data(), s.data() + s.size(), v );
+            if( ec != std::errc() || end != s.data() + s.size() ) throw std::runtime_error( "invalid number" );
+            return v;
+         }
+
+         name      _contract;
+         uint32_t  _block = 0;
+         symbol    _token;
+
+         std::map<std::pair<uint64_t, uint64_t>, asset>               _balances;          // (owner, symbol code)
+         std::map<uint64_t, cristaltoken::currency_stats_row>         _stats;
+         std::map<uint64_t, cristaltoken::customer_row>               _customers;
+         std::map<uint64_t, customer_view>                            _legacy_customers;
+         std::map<pap_key, pap_view>                                  _paps;
+         std::set<std::tuple<uint64_t, uint64_t, bool>>               _schedule;          // (by_due, id, legacy)
+         std::set<std::pair<uint64_t, pap_key>>                       _by_account;
+         std::deque<frame>                                            _frames;            // blocks that can be undone, oldest first
+
+         cristaltoken::account_row          _account_row;
+         cristaltoken::currency_stats_row   _stats_row;
+         cristaltoken::config_row           _config_row;
+         cristaltoken::legacy_customer_row  _legacy_customer_row;
+         cristaltoken::pap_row              _pap_row;
+         cristaltoken::legacy_pap_row       _legacy_pap_row;
+   };
+
+   // chain_state_history.log: entries of a header (magic, block id, payload size), the
+   // payload and the entry's own position. The payload of a table delta entry is a uint32
+   // size followed by the zlib compressed `table_delta[]`.
+   class state_history_log {
+      public:
+         explicit state_history_log( const char* path ) {
+            _fd = ::open( path, O_RDONLY );
+            check( _fd >= 0, "cannot open state history log" );
+         }
+         ~state_history_log() { if( _fd >= 0 ) ::close( _fd ); }
+         state_history_log( const state_history_log& ) = delete;
+         state_history_log& operator=( const state_history_log& ) = delete;
+
+         // Applies the entries written since the last call, undoing first the applied blocks
+         // a fork switch replaced; returns false if blocks that cannot be undone were
+         // replaced, in which case the log must be read again from the start.
+         bool read_new( name contract, contract_state& state ) {
+            struct stat st;
+            check( ::fstat( _fd, &st ) == 0, "cannot stat state history log" );
+
+            // nodeos truncates the log at the first replaced block and appends the new
+            // branch, possibly with as many bytes: undo the blocks whose entry is gone.
+            char header[header_size];
+            uint32_t undone = 0;
+            while( !_entries.empty() && !in_place( _entries.back(), st.st_size, header ) ) {
+               if( !state.undo_block() ) return false;
+               _entries.pop_back();
+               ++undone;
+            }
+            if( !_entries.empty() ) _offset = _entries.back().end;
+            if( undone > 0 )
+               std::fprintf( stderr, "state history log rewritten, %u blocks undone back to block %u\n", undone, state.block() );
+
+            while( _offset + header_size <= uint64_t( st.st_size ) ) {
+               read_at( header, header_size, _offset );
+               uint64_t magic = 0, payload_size = 0;
+               std::memcpy( &magic, header, 8 );
+               std::memcpy( &payload_size, header + 40, 8 );
+               check( ( magic & ship_magic_mask ) == ( "ship"_n.value & ship_magic_mask ) && uint32_t( magic ) <= ship_max_version,
+                      "not a state history log (bad magic number or version)" );
+               if( _offset + header_size + payload_size + 8 > uint64_t( st.st_size ) )
+                  break;  // entry still being written
+
+               // Block number: the first 4 bytes of the block id, big endian.
+               const auto* id = reinterpret_cast<const unsigned char*>( header + 8 );
+               uint32_t block = uint32_t( id[0] ) << 24 | uint32_t( id[1] ) << 16 | uint32_t( id[2] ) << 8 | id[3];
+               if( block <= state.block() && state.block() != 0 ) {
+                  // A block at or below the last one applied replaces it and its successors.
+                  undone = 0;
+                  while( state.block() >= block ) {
+                     if( !state.undo_block() ) return false;
+                     _entries.pop_back();
+                     ++undone;
+                  }
+                  std::fprintf( stderr, "block %u replaces applied blocks, %u blocks undone\n", block, undone );
+               }
+
+               _payload.resize( payload_size );
+               read_at( _payload.data(), payload_size, _offset + header_size );
+               check( payload_size >= 4, "corrupted state history entry" );
+               uint32_t compressed = 0;
+               std::memcpy( &compressed, _payload.data(), 4 );
+               check( compressed <= payload_size - 4, "corrupted state history entry" );
+               inflate_into( _payload.data() + 4, compressed, _deltas );
+
+               datastream<const char*> ds( _deltas.data(), _deltas.size() );
+               state.begin_block( block );
+               decode_deltas( ds, contract, state );
+
+               entry e{ _offset, _offset + header_size + payload_size + 8, {} };
+               std::memcpy( e.id, header + 8, sizeof( e.id ) );
+               _entries.push_back( e );
+               if( _entries.size() > undo_blocks + 1 ) _entries.pop_front();
+               _offset = e.end;
+            }
+            return true;
+         }
+
+         void rewind() { _offset = 0; _entries.clear(); }
+
+      private:
+         static constexpr std::size_t header_size = 8 + 32 + 8;
+
+         // Position and block id of an applied entry.
+         struct entry {
+            uint64_t  offset;
+            uint64_t  end;
+            char      id[32];
+         };
+
+         // Whether the log still holds `e`, with the same block id.
+         bool in_place( const entry& e, uint64_t size, char* header ) {
+            if( e.end > size ) return false;
+            read_at( header, header_size, e.offset );
+            return std::memcmp( header + 8, e.id, sizeof( e.id ) ) == 0;
+         }
+
+         void read_at( char* buf, std::size_t size, uint64_t offset ) {
+            while( size > 0 ) {
+               auto n = ::pread( _fd, buf, size, offset );
+               check( n > 0, "cannot read state history log" );
+               buf += n;  size -= n;  offset += n;
+            }
+         }
+
+         static void inflate_into( const char* data, std::size_t size, std::vector<char>& out ) {
+            z_stream zs{};
+            check( inflateInit( &zs ) == Z_OK, "cannot initialize zlib" );
+            zs.next_in = reinterpret_cast<Bytef*>( const_cast<char*>( data ) );
+            zs.avail_in = size;
+            out.resize( std::max<std::size_t>( out.capacity(), size * 4 ) );
+            std::size_t used = 0;
+            int rc = Z_OK;
+            while( rc != Z_STREAM_END ) {
+               if( used == out.size() ) out.resize( out.size() * 2 );
+               zs.next_out = reinterpret_cast<Bytef*>( out.data() + used );
+               zs.avail_out = out.size() - used;
+               rc = ::inflate( &zs, Z_NO_FLUSH );
+               used = out.size() - zs.avail_out;
+               if( rc != Z_OK && rc != Z_STREAM_END ) break;
+            }
+            inflateEnd( &zs );
+            check( rc == Z_STREAM_END, "corrupted compressed state history entry" );
+            out.resize( used );
+         }
+
+         // table_delta[]: variant index, table name and rows of (present, bytes). Rows of
+         // `contract_row` are a variant index, code, scope, table, primary key, payer and the
+         // packed row value.
+         static void decode_deltas( datastream<const char*>& ds, name contract, contract_state& state ) {
+            auto tables = native::read_varuint32( ds );
+            std::string table_name;
+            for( uint32_t t = 0; t < tables; ++t ) {
+               native::read_varuint32( ds );  // table_delta_v0
+               ds >> table_name;
+               const bool contract_rows = table_name == "contract_row";
+               auto rows = native::read_varuint32( ds );
+               for( uint32_t r = 0; r < rows; ++r ) {
+                  bool present = false;
+                  ds >> present;
+                  auto size = native::read_varuint32( ds );
+                  if( contract_rows ) {
+                     datastream<const char*> row( ds.pos(), size );
+                     native::read_varuint32( row );  // contract_row_v0
+                     uint64_t code = 0, scope = 0, table = 0, primary_key = 0, payer = 0;
+                     row >> code >> scope >> table >> primary_key >> payer;
+                     if( code == contract.value ) {
+                        auto value_size = native::read_varuint32( row );
+                        datastream<const char*> value( row.pos(), value_size );
+                        state.apply( name( table ), scope, primary_key, present, value );
+                     }
+                  }
+                  ds.skip( size );
+               }
+            }
+         }
+
+         int                _fd = -1;
+         uint64_t           _offset = 0;
+         std::deque<entry>  _entries;          // applied entries that can be undone, and the one before them
+         std::vector<char>  _payload;
+         std::vector<char>  _deltas;
+   };
+
+   // Line oriented unix socket server; requests are answered from `state` in between log reads.
+   class query_server {
+      public:
+         explicit query_server( const char* path ) : _path( path ) {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            check( std::strlen( path ) < sizeof( addr.sun_path ), "socket path too long" );
+            std::strcpy( addr.sun_path, path );
+            ::unlink( path );
+            _listen = ::socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0 );
+            check( _listen >= 0, "cannot create socket" );
+            check( ::bind( _listen, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) == 0, "cannot bind socket" );
+            check( ::listen( _listen, 16 ) == 0, "cannot listen on socket" );
+         }
+         ~query_server() {
+            for( auto& c : _clients ) ::close( c.fd );
+            if( _listen >= 0 ) ::close( _listen );
+            ::unlink( _path.c_str() );
+         }
+         query_server( const query_server& ) = delete;
+         query_server& operator=( const query_server& ) = delete;
+
+         // Serves requests for up to `timeout_ms` (-1: until a signal interrupts poll).
+         void serve( const contract_state& state, int timeout_ms ) {
+            std::vector<pollfd> fds{ { _listen, POLLIN, 0 } };
+            for( const auto& c : _clients ) fds.push_back( { c.fd, POLLIN, 0 } );
+            int n = ::poll( fds.data(), fds.size(), timeout_ms );
+            if( n <= 0 ) return;
+
+            for( std::size_t i = fds.size(); i-- > 1; ) {
+               if( fds[i].revents == 0 ) continue;
+               if( !read_client( _clients[i - 1], state ) ) {
+                  ::close( _clients[i - 1].fd );
+                  _clients.erase( _clients.begin() + ( i - 1 ) );
+               }
+            }
+            if( fds[0].revents & POLLIN ) {
+               int fd;
+               while( ( fd = ::accept( _listen, nullptr, nullptr ) ) >= 0 )
+                  _clients.push_back( { fd, {} } );
+            }
+         }
+
+      private:
+         struct client {
+            int          fd;
+            std::string  input;
+         };
+
+         static bool read_client( client& c, const contract_state& state ) {
+            char buf[4096];
+            auto n = ::recv( c.fd, buf, sizeof( buf ), 0 );
+            if( n <= 0 ) return false;
+            c.input.append( buf, n );
+
+            std::string out;
+            std::size_t start = 0, end;
+            while( ( end = c.input.find( '\n', start ) ) != c.input.npos ) {
+               try {
+                  state.query( std::string_view( c.input ).substr( start, end - start ), out );
+               } catch( const std::exception& e ) {
+                  out += std::string( "error: " ) + e.what() + "\n";
+               }
+               out += "\n";
+               start = end + 1;
+            }
+            c.input.erase( 0, start );
+            if( c.input.size() > 4096 ) return false;
+            return out.empty() || ::send( c.fd, out.data(), out.size(), MSG_NOSIGNAL ) == ssize_t( out.size() );
+         }
+
+         std::string          _path;
+         int                  _listen = -1;
+         std::vector<client>  _clients;
+   };
+
+} /// namespace
+
+int main( int argc, char** argv ) {
+   const bool follow = argc == 5 && std::strcmp( argv[4], "--follow" ) == 0;
+   if( argc != 4 && !follow ) {
+      std::fprintf( stderr, "usage: %s <chain_state_history.log> <contract account> <socket path> [--follow]\n", argv[0] );
+      return 2;
+   }
+   try {
+      const name contract{ std::string_view( argv[2] ) };
+      state_history_log log( argv[1] );
+      contract_state state( contract );
+      query_server server( argv[3] );
+
+      bool loaded = false, rebuilding = false;
+      while( true ) {
+         if( follow || !loaded ) {
+            if( !log.read_new( contract, state ) ) {
+               // Read from the start, so the log itself is out of order.
+               check( !rebuilding, "state history log blocks are out of order" );
+               std::fprintf( stderr, "state history log rewritten at block %u, rebuilding\n", state.block() );
+               state.clear();
+               log.rewind();
+               rebuilding = true;
+               continue;
+            }
+            loaded = true;
+            rebuilding = false;
+         }
+         server.serve( state, follow ? follow_interval_ms : -1 );
+      }
+   } catch( const std::exception& e ) {
+      std::fprintf( stderr, "error: %s\n", e.what() );
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,613 @@
+// Offline PAP billing planner.
+//
+// Loads the CSV files written by cristaltoken_tabledump (accounts, customers, customer, paps
+// and pap) and plans the charges a biller can push at a given time: the PAPs that are
+// enabled, due and not finished, and that their account can pay, balance plus credit line,
+// fee included. The charges are written as packed, unsigned transactions:
+//
+//    cristaltoken_planner <csv directory> <contract account> <output file> [--at <unix seconds>]
+//                         [--per-tx <actions>] [--threads <n>] [--as-contract] [--memo <text>]
+//
+// A PAP with one period due is charged with `chargepap`, one with several with `catchuppap`
+// (one debit and one fee for all of them). An account is only planned what its own funds
+// cover: credits it may receive as a provider are ignored, so every planned charge succeeds
+// whatever the order the transactions are pushed in. Charges are signed by their provider,
+// or by the contract with --as-contract; a transaction holds the charges of one signer, at
+// most --per-tx of them (default 50), to stay within the transaction CPU limit.
+//
+// Output: for each transaction, its size as a little endian uint32 followed by the packed
+// `transaction`. Its header (expiration, ref_block_num, ref_block_prefix: the first 10
+// bytes) is zero and has to be set by the sender before signing.
+//
+// Files are parsed in chunks and accounts planned in batches on a work stealing thread
+// pool (--threads, default one per core).
+
+#include <cristaltoken.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace eosio;
+using ct = cristaltoken;
+
+namespace {
+
+   // Runs batches of tasks on a fixed set of threads, the caller included. Every thread
+   // takes tasks from the back of its own queue and, once it is empty, steals from the front
+   // of the others', so batches of uneven cost keep every core busy.
+   class work_stealing_pool {
+      public:
+         explicit work_stealing_pool( unsigned threads ) : _queues( std::max( threads, 1u ) ) {
+            for( unsigned i = 1; i < _queues.size(); ++i )
+               _threads.emplace_back( [this, i] { work( i ); } );
+         }
+         ~work_stealing_pool() {
+            {
+               std::lock_guard lock( _mutex );
+               _stop = true;
+            }
+            _wake.notify_all();
+            for( auto& t : _threads ) t.join();
+         }
+         work_stealing_pool( const work_stealing_pool& ) = delete;
+         work_stealing_pool& operator=( const work_stealing_pool& ) = delete;
+
+         unsigned size()const { return _queues.size(); }
+
+         // Runs task( i ) for every i in [0, count) and returns once they all ran; the first
+         // exception thrown by a task is rethrown here.
+         void run( std::size_t count, const std::function<void( std::size_t )>& task ) {
+            if( count == 0 ) return;
+            _task = &task;
+            _pending = count;
+            for( std::size_t i = 0; i < count; ++i )
+               _queues[i % _queues.size()].push( i );
+            {
+               std::lock_guard lock( _mutex );
+               ++_generation;
+            }
+            _wake.notify_all();
+
+            drain( 0 );
+            std::unique_lock lock( _mutex );
+            _done.wait( lock, [this] { return _pending == 0; } );
+            if( _error ) std::rethrow_exception( std::exchange( _error, nullptr ) );
+         }
+
+      private:
+         class queue {
+            public:
+               void push( std::size_t item ) {
+                  std::lock_guard lock( _mutex );
+                  _items.push_back( item );
+               }
+               bool pop_back( std::size_t& item ) {
+                  std::lock_guard lock( _mutex );
+                  if( _items.empty() ) return false;
+                  item = _items.back();
+                  _items.pop_back();
+                  return true;
+               }
+               bool steal( std::size_t& item ) {
+                  std::lock_guard lock( _mutex );
+                  if( _items.empty() ) return false;
+                  item = _items.front();
+                  _items.pop_front();
+                  return true;
+               }
+
+            private:
+               std::mutex               _mutex;
+               std::deque<std::size_t>  _items;
+         };
+
+         bool next( unsigned self, std::size_t& item ) {
+            if( _queues[self].pop_back( item ) ) return true;
+            for( unsigned i = 1; i < _queues.size(); ++i )
+               if( _queues[( self + i ) % _queues.size()].steal( item ) ) return true;
+            return false;
+         }
+
+         void drain( unsigned self ) {
+            std::size_t item = 0;
+            while( next( self, item ) ) {
+               try {
+                  ( *_task.load() )( item );
+               } catch( ... ) {
+                  std::lock_guard lock( _mutex );
+                  if( !_error ) _error = std::current_exception();
+               }
+               if( --_pending == 0 ) {
+                  std::lock_guard lock( _mutex );
+                  _done.notify_all();
+               }
+            }
+         }
+
+         void work( unsigned self ) {
+            uint64_t seen = 0;
+            while( true ) {
+               {
+                  std::unique_lock lock( _mutex );
+                  _wake.wait( lock, [&] { return _stop || _generation != seen; } );
+                  if( _stop ) return;
+                  seen = _generation;
+               }
+               drain( self );
+            }
+         }
+
+         std::vector<queue>                                          _queues;
+         std::vector<std::thread>                                    _threads;
+         std::atomic<const std::function<void( std::size_t )>*>     _task{ nullptr };
+         std::atomic<std::size_t>                                    _pending{ 0 };
+         std::mutex                                                  _mutex;
+         std::condition_variable                                     _wake;
+         std::condition_variable                                     _done;
+         uint64_t                                                    _generation = 0;
+         bool                                                        _stop = false;
+         std::exception_ptr                                          _error;
+   };
+
+   // Read only mapping of a whole file; an empty or missing optional file maps to nothing.
+   class mapped_file {
+      public:
+         mapped_file( const std::string& path, bool optional ) {
+            _fd = ::open( path.c_str(), O_RDONLY );
+            if( _fd < 0 && optional ) return;
+            check( _fd >= 0, "cannot open " + path );
+            struct stat st;
+            check( ::fstat( _fd, &st ) == 0, "cannot stat " + path );
+            _size = st.st_size;
+            if( _size == 0 ) return;
+            void* data = ::mmap( nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0 );
+            check( data != MAP_FAILED, "cannot map " + path );
+            _data = static_cast<const char*>( data );
+         }
+         ~mapped_file() {
+            if( _data ) ::munmap( const_cast<char*>( _data ), _size );
+            if( _fd >= 0 ) ::close( _fd );
+         }
+         mapped_file( const mapped_file& ) = delete;
+         mapped_file& operator=( const mapped_file& ) = delete;
+
+         std::string_view view()const { return { _data, _data ? _size : 0 }; }
+
+      private:
+         int          _fd   = -1;
+         const char*  _data = nullptr;
+         std::size_t  _size = 0;
+   };
+
+   // Fails with "<what> in <file>"; the message is only built on failure.
+   inline void check_csv( bool pred, const char* what, const char* file ) {
+      if( !pred ) check( false, std::string( what ) + " in " + file );
+   }
+
+   // Fields of one CSV line, as written by cristaltoken_tabledump (no quoting).
+   class csv_fields {
+      public:
+         csv_fields( std::string_view line, const char* file ) : _rest( line ), _file( file ) {}
+
+         std::string_view next() {
+            check_csv( _rest.data() != nullptr, "missing column", _file );
+            auto comma = _rest.find( ',' );
+            auto field = _rest.substr( 0, comma );
+            _rest = comma == std::string_view::npos ? std::string_view() : _rest.substr( comma + 1 );
+            return field;
+         }
+
+         name as_name() { return name( next() ); }
+
+         template<typename Int>
+         Int as_int() {
+            auto field = next();
+            Int v = 0;
+            auto r = std::from_chars( field.data(), field.data() + field.size(), v );
+            check_csv( r.ec == std::errc() && r.ptr == field.data() + field.size(), "invalid number", _file );
+            return v;
+         }
+
+         // "-12.3400 INK": the precision is the number of decimals.
+         asset as_asset() {
+            auto field = next();
+            auto space = field.find( ' ' );
+            check_csv( space != std::string_view::npos, "invalid asset", _file );
+            auto amount = field.substr( 0, space );
+            bool negative = !amount.empty() && amount[0] == '-';
+            if( negative ) amount.remove_prefix( 1 );
+            int64_t units = 0;
+            uint8_t precision = 0;
+            bool decimals = false;
+            for( char c : amount ) {
+               if( c == '.' && !decimals ) { decimals = true; continue; }
+               check_csv( c >= '0' && c <= '9', "invalid asset", _file );
+               units = units * 10 + ( c - '0' );
+               if( decimals ) ++precision;
+            }
+            return asset( negative ? -units : units, symbol( field.substr( space + 1 ), precision ) );
+         }
+
+      private:
+         std::string_view  _rest;
+         const char*       _file;
+   };
+
+   struct balance_row   { name owner; asset balance; };
+   struct customer_row  { name key; asset fee; asset overdraft; uint32_t state; uint8_t flags; };
+   struct pap_row       { name account; name provider; uint32_t service_id; asset price;
+                          uint32_t begins_at; uint32_t periods; uint32_t last_charged; bool enabled; };
+
+   // Splits `text`, header line excluded, into about `parts` ranges of whole lines.
+   std::vector<std::string_view> split_lines( std::string_view text, std::size_t parts ) {
+      std::vector<std::string_view> ranges;
+      auto header = text.find( '\n' );
+      if( header == std::string_view::npos ) return ranges;
+      text.remove_prefix( header + 1 );
+      const std::size_t step = std::max<std::size_t>( text.size() / std::max<std::size_t>( parts, 1 ), 1 );
+      while( !text.empty() ) {
+         auto end = text.size() <= step ? std::string_view::npos : text.find( '\n', step );
+         end = end == std::string_view::npos ? text.size() : end + 1;
+         ranges.push_back( text.substr( 0, end ) );
+         text.remove_prefix( end );
+      }
+      return ranges;
+   }
+
+   // Parses every line of `file` with parse( csv_fields&, std::vector<Row>& ), one chunk per
+   // task, and returns the rows in file order.
+   template<typename Row, typename Parse>
+   std::vector<Row> load( work_stealing_pool& pool, const std::string& dir, const char* file, bool optional, Parse&& parse ) {
+      mapped_file mapped( dir + "/" + file, optional );
+      auto ranges = split_lines( mapped.view(), pool.size() * 8 );
+      std::vector<std::vector<Row>> chunks( ranges.size() );
+      pool.run( ranges.size(), [&]( std::size_t i ) {
+         auto text = ranges[i];
+         while( !text.empty() ) {
+            auto end = text.find( '\n' );
+            auto line = text.substr( 0, end );
+            text.remove_prefix( end == std::string_view::npos ? text.size() : end + 1 );
+            if( line.empty() ) continue;
+            csv_fields fields( line, file );
+            parse( fields, chunks[i] );
+         }
+      });
+      std::vector<Row> rows;
+      for( auto& chunk : chunks ) rows.insert( rows.end(), chunk.begin(), chunk.end() );
+      return rows;
+   }
+
+   struct tables {
+      std::vector<balance_row>   balances;
+      std::vector<customer_row>  customers;
+      std::vector<pap_row>       paps;
+   };
+
+   tables load_tables( work_stealing_pool& pool, const std::string& dir, name contract ) {
+      tables t;
+      t.balances = load<balance_row>( pool, dir, "accounts.csv", false, []( csv_fields& f, auto& rows ) {
+         auto owner = f.as_name();
+         rows.push_back( { owner, f.as_asset() } );
+      });
+
+      // Customers and PAPs of other scopes are not the contract's own (see get_first_receiver).
+      auto customer = [&]( bool legacy ) {
+         return [&, legacy]( csv_fields& f, auto& rows ) {
+            if( f.as_name() != contract ) return;
+            customer_row c;
+            c.key = f.as_name();
+            if( !legacy ) f.next();  // layout
+            c.fee = f.as_asset();
+            c.overdraft = f.as_asset();
+            f.next();                // account_type
+            c.state = f.as_int<uint32_t>();
+            c.flags = legacy ? 0 : f.as_int<uint8_t>();
+            rows.push_back( c );
+         };
+      };
+      t.customers = load<customer_row>( pool, dir, "customers.csv", true, customer( false ) );
+      auto legacy_customers = load<customer_row>( pool, dir, "customer.csv", true, customer( true ) );
+      t.customers.insert( t.customers.end(), legacy_customers.begin(), legacy_customers.end() );
+
+      auto pap = [&]( bool legacy ) {
+         return [&, legacy]( csv_fields& f, auto& rows ) {
+            if( f.as_name() != contract ) return;
+            pap_row p;
+            f.next();                // id
+            if( !legacy ) f.next();  // layout
+            p.account = f.as_name();
+            p.provider = f.as_name();
+            p.service_id = f.as_int<uint32_t>();
+            p.price = f.as_asset();
+            p.begins_at = f.as_int<uint32_t>();
+            p.periods = f.as_int<uint32_t>();
+            p.last_charged = f.as_int<uint32_t>();
+            auto state = f.as_int<uint32_t>();
+            p.enabled = legacy ? state == ct::STATE_ENABLED : ( state & ct::PAP_FLAG_ENABLED ) != 0;
+            rows.push_back( p );
+         };
+      };
+      t.paps = load<pap_row>( pool, dir, "paps.csv", true, pap( false ) );
+      auto legacy_paps = load<pap_row>( pool, dir, "pap.csv", true, pap( true ) );
+      t.paps.insert( t.paps.end(), legacy_paps.begin(), legacy_paps.end() );
+      return t;
+   }
+
+   struct charge {
+      name      actor;
+      name      account;
+      name      provider;
+      uint32_t  service_id;
+      asset     price;
+      uint32_t  periods;     // charged by this action
+   };
+
+   struct plan_stats {
+      uint64_t  not_due = 0;
+      uint64_t  unfunded = 0;
+      uint64_t  charges = 0;
+      uint64_t  periods = 0;
+   };
+
+   struct balance_key {
+      uint64_t  owner;
+      uint64_t  sym;
+      bool operator==( const balance_key& ) const = default;
+   };
+
+   struct balance_key_hash {
+      std::size_t operator()( const balance_key& k ) const { return k.owner ^ ( k.sym * 0x9e3779b97f4a7c15ull ); }
+   };
+
+   using balance_map = std::unordered_map<balance_key, int64_t, balance_key_hash>;
+
+   // Plans the PAPs of one account, `paps` sorted by due time, as charge_pap would run them
+   // at `now` (see ERR_PAP_NOT_DUE, ERR_PAP_ENDED and sub_balance).
+   void plan_account( const pap_row* paps, std::size_t count, uint32_t now, bool as_contract, name contract,
+                      const balance_map& balances, const std::unordered_map<uint64_t, customer_row>& customers,
+                      std::vector<asset>& available, std::vector<charge>& out, plan_stats& stats ) {
+      const auto account = paps[0].account;
+      auto c = customers.find( account.value );
+      available.clear();  // per token: balance plus credit line, less the planned debits
+
+      for( std::size_t i = 0; i < count; ++i ) {
+         const auto& p = paps[i];
+         const uint64_t next_charge_at = uint64_t( p.begins_at ) + uint64_t( p.last_charged + 1 ) * ct::REQUIRED_PERIOD_DURATION;
+         if( !p.enabled || p.last_charged >= p.periods || now < next_charge_at ) {
+            ++stats.not_due;
+            continue;
+         }
+         const auto sym = p.price.symbol;
+         auto funds = std::find_if( available.begin(), available.end(), [&]( const asset& a ) { return a.symbol == sym; } );
+         if( funds == available.end() ) {
+            auto b = balances.find( { account.value, sym.raw() } );
+            int64_t amount = b != balances.end() ? b->second : 0;
+            if( c != customers.end() && ( c->second.flags & ct::CUST_FLAG_CREDIT_LINE ) && c->second.state == ct::STATE_ENABLED
+                && c->second.overdraft.symbol == sym )
+               amount += c->second.overdraft.amount;
+            available.push_back( asset( amount, sym ) );
+            funds = available.end() - 1;
+         }
+
+         int64_t fee = 0;
+         if( c != customers.end() && c->second.fee.symbol == sym && c->second.fee.amount > 0 )
+            fee = c->second.fee.amount;
+         const uint32_t elapsed = ( now - p.begins_at ) / ct::REQUIRED_PERIOD_DURATION;
+         const uint64_t due = std::min( elapsed, p.periods ) - p.last_charged;
+         // The fee is owed per charged period (see catchuppap).
+         uint64_t periods = 0;
+         if( p.price.amount > 0 && funds->amount >= p.price.amount + fee )
+            periods = std::min<uint64_t>( due, uint64_t( funds->amount ) / uint64_t( p.price.amount + fee ) );
+         if( periods == 0 ) {
+            ++stats.unfunded;
+            continue;
+         }
+
+         funds->amount -= int64_t( periods ) * ( p.price.amount + fee );
+         out.push_back( { as_contract ? contract : p.provider, account, p.provider, p.service_id, p.price, uint32_t( periods ) } );
+         ++stats.charges;
+         stats.periods += periods;
+      }
+   }
+
+   std::vector<charge> plan( work_stealing_pool& pool, tables& t, uint32_t now, bool as_contract, name contract, plan_stats& stats ) {
+      balance_map balances;
+      balances.reserve( t.balances.size() );
+      for( const auto& b : t.balances ) balances.emplace( balance_key{ b.owner.value, b.balance.symbol.raw() }, b.balance.amount );
+      std::unordered_map<uint64_t, customer_row> customers;
+      customers.reserve( t.customers.size() );
+      for( const auto& c : t.customers ) customers.emplace( c.key.value, c );  // `customers` before `customer`
+
+      // Accounts are planned one after the other and their PAPs by due time, as a biller
+      // charging in due order would.
+      std::sort( t.paps.begin(), t.paps.end(), []( const pap_row& a, const pap_row& b ) {
+         const uint64_t due_a = uint64_t( a.begins_at ) + uint64_t( a.last_charged + 1 ) * ct::REQUIRED_PERIOD_DURATION;
+         const uint64_t due_b = uint64_t( b.begins_at ) + uint64_t( b.last_charged + 1 ) * ct::REQUIRED_PERIOD_DURATION;
+         return std::tie( a.account, due_a, a.provider, a.service_id ) < std::tie( b.account, due_b, b.provider, b.service_id );
+      });
+
+      // Batches of whole accounts, several per thread so that stealing evens them out.
+      std::vector<std::size_t> starts;
+      const std::size_t step = std::max<std::size_t>( t.paps.size() / ( pool.size() * 16 ), 1 );
+      for( std::size_t i = 0; i < t.paps.size(); ) {
+         starts.push_back( i );
+         i = std::min( i + step, t.paps.size() );
+         while( i < t.paps.size() && t.paps[i].account == t.paps[i - 1].account ) ++i;
+      }
+      starts.push_back( t.paps.size() );
+
+      std::vector<std::vector<charge>> planned( starts.size() - 1 );
+      std::vector<plan_stats> batch_stats( planned.size() );
+      pool.run( planned.size(), [&]( std::size_t b ) {
+         std::vector<asset> available;
+         for( std::size_t i = starts[b]; i < starts[b + 1]; ) {
+            std::size_t end = i + 1;
+            while( end < starts[b + 1] && t.paps[end].account == t.paps[i].account ) ++end;
+            plan_account( &t.paps[i], end - i, now, as_contract, contract, balances, customers, available, planned[b], batch_stats[b] );
+            i = end;
+         }
+      });
+
+      std::vector<charge> charges;
+      for( std::size_t b = 0; b < planned.size(); ++b ) {
+         charges.insert( charges.end(), planned[b].begin(), planned[b].end() );
+         stats.not_due += batch_stats[b].not_due;
+         stats.unfunded += batch_stats[b].unfunded;
+         stats.charges += batch_stats[b].charges;
+         stats.periods += batch_stats[b].periods;
+      }
+      // One signer per transaction: group by actor, keeping the planned order within.
+      std::stable_sort( charges.begin(), charges.end(), []( const charge& a, const charge& b ) { return a.actor < b.actor; } );
+      return charges;
+   }
+
+   // Chain binary serialization of the few types a transaction needs.
+   class packer {
+      public:
+         explicit packer( std::string& out ) : _out( out ) {}
+
+         packer& raw( const void* data, std::size_t size ) { _out.append( static_cast<const char*>( data ), size ); return *this; }
+         template<typename Int>
+         packer& operator<<( Int v ) { static_assert( std::is_integral_v<Int> ); return raw( &v, sizeof( v ) ); }
+         packer& operator<<( name n )                { return *this << n.value; }
+         packer& operator<<( const asset& a )        { return *this << a.amount << a.symbol.raw(); }
+         packer& operator<<( std::string_view s )    { varuint( s.size() ); return raw( s.data(), s.size() ); }
+         packer& varuint( uint64_t v ) {
+            do {
+               uint8_t b = v & 0x7f;
+               v >>= 7;
+               *this << uint8_t( b | ( v ? 0x80 : 0 ) );
+            } while( v );
+            return *this;
+         }
+
+      private:
+         std::string& _out;
+   };
+
+   std::size_t varuint_size( uint64_t v ) {
+      std::size_t n = 1;
+      while( v >>= 7 ) ++n;
+      return n;
+   }
+
+   // chargepap or catchuppap action of `c`.
+   void pack_action( packer& p, const charge& c, name contract, std::string_view memo ) {
+      const bool catchup = c.periods > 1;
+      p << contract << ( catchup ? "catchuppap"_n : "chargepap"_n );
+      p.varuint( 1 ) << c.actor << "active"_n;
+      p.varuint( 8 + 8 + 4 + 16 + ( catchup ? 4 : 0 ) + varuint_size( memo.size() ) + memo.size() );
+      p << c.account << c.provider << c.service_id << c.price;
+      if( catchup ) p << c.periods;
+      p << memo;
+   }
+
+   // Unsigned transaction of `count` charges, with a zero header (expiration and TaPoS).
+   void pack_transaction( std::string& out, const charge* charges, std::size_t count, name contract, std::string_view memo ) {
+      out.reserve( 16 + count * ( 96 + memo.size() ) );
+      packer p( out );
+      p << uint32_t( 0 ) << uint16_t( 0 ) << uint32_t( 0 );  // expiration, ref_block_num, ref_block_prefix
+      p.varuint( 0 ) << uint8_t( 0 );                          // max_net_usage_words, max_cpu_usage_ms
+      p.varuint( 0 );                                          // delay_sec
+      p.varuint( 0 );                                          // context_free_actions
+      p.varuint( count );
+      for( std::size_t i = 0; i < count; ++i ) pack_action( p, charges[i], contract, memo );
+      p.varuint( 0 );                                          // transaction_extensions
+   }
+
+   uint64_t write_transactions( work_stealing_pool& pool, const std::vector<charge>& charges, uint32_t per_tx,
+                                name contract, std::string_view memo, const char* path ) {
+      std::vector<std::size_t> starts;
+      for( std::size_t i = 0; i < charges.size(); ) {
+         starts.push_back( i );
+         std::size_t end = i + 1;
+         while( end < charges.size() && end - i < per_tx && charges[end].actor == charges[i].actor ) ++end;
+         i = end;
+      }
+      starts.push_back( charges.size() );
+
+      std::vector<std::string> packed( starts.size() - 1 );
+      pool.run( packed.size(), [&]( std::size_t t ) {
+         pack_transaction( packed[t], &charges[starts[t]], starts[t + 1] - starts[t], contract, memo );
+      });
+
+      std::FILE* out = std::fopen( path, "wb" );
+      check( out != nullptr, std::string( "cannot create " ) + path );
+      std::setvbuf( out, nullptr, _IOFBF, 1 << 20 );
+      for( const auto& tx : packed ) {
+         uint32_t size = tx.size();
+         std::fwrite( &size, sizeof( size ), 1, out );
+         std::fwrite( tx.data(), 1, tx.size(), out );
+      }
+      check( std::fclose( out ) == 0, std::string( "cannot write " ) + path );
+      return packed.size();
+   }
+
+} /// namespace
+
+int main( int argc, char** argv ) {
+   if( argc < 4 ) {
+      std::fprintf( stderr, "usage: %s <csv directory> <contract account> <output file> [--at <unix seconds>]\n"
+                            "       [--per-tx <actions>] [--threads <n>] [--as-contract] [--memo <text>]\n", argv[0] );
+      return 2;
+   }
+   uint32_t now = std::time( nullptr );
+   uint32_t per_tx = 50;
+   unsigned threads = std::max( std::thread::hardware_concurrency(), 1u );
+   bool as_contract = false;
+   std::string memo;
+   for( int i = 4; i < argc; ++i ) {
+      if( std::strcmp( argv[i], "--at" ) == 0 && i + 1 < argc )               now = std::stoul( argv[++i] );
+      else if( std::strcmp( argv[i], "--per-tx" ) == 0 && i + 1 < argc )     per_tx = std::max( std::stoul( argv[++i] ), 1ul );
+      else if( std::strcmp( argv[i], "--threads" ) == 0 && i + 1 < argc )    threads = std::max( std::stoul( argv[++i] ), 1ul );
+      else if( std::strcmp( argv[i], "--as-contract" ) == 0 )                as_contract = true;
+      else if( std::strcmp( argv[i], "--memo" ) == 0 && i + 1 < argc )       memo = argv[++i];
+      else {
+         std::fprintf( stderr, "error: unknown option %s\n", argv[i] );
+         return 2;
+      }
+   }
+
+   try {
+      const name contract{ std::string_view( argv[2] ) };
+      check( memo.size() <= 256, "memo has more than 256 bytes" );
+      auto start = std::chrono::steady_clock::now();
+
+      work_stealing_pool pool( threads );
+      auto t = load_tables( pool, argv[1], contract );
+      const auto pap_count = t.paps.size();
+      plan_stats stats;
+      auto charges = plan( pool, t, now, as_contract, contract, stats );
+      auto transactions = write_transactions( pool, charges, per_tx, contract, memo, argv[3] );
+
+      auto ms = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count();
+      std::printf( "paps=%llu not_due=%llu unfunded=%llu charges=%llu periods=%llu transactions=%llu threads=%u ms=%lld\n",
+                   (unsigned long long)pap_count, (unsigned long long)stats.not_due, (unsigned long long)stats.unfunded,
+                   (unsigned long long)stats.charges, (unsigned long long)stats.periods,
+                   (unsigned long long)transactions, pool.size(), (long long)ms );
+   } catch( const std::exception& e ) {
+      std::fprintf( stderr, "error: %s\n", e.what() );
+      return 1;
+   }
+   return 0;
+}
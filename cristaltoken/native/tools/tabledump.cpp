@@ -0,0 +1,299 @@
+// Offline decoder of the cristaltoken tables.
+//
+// Reads a nodeos portable snapshot (producer_api/create_snapshot, the `.bin` file) and
+// writes every row of the contract's `accounts`, `stat`, `customers`, `feepool`, `paps`
+// and legacy `customer` and `pap` tables to one CSV file per table:
+//
+//    cristaltoken_tabledump <snapshot.bin> <contract account> [output directory]
+//
+// The snapshot is memory mapped. Its contract tables are walked twice: once for the
+// contract token (`config`), which packed `customers` rows need, then to write the rows.
+// Rows are unpacked in place into the contract's own row types (cristaltoken::*_row) and
+// formatted into a fixed buffer, so nothing is allocated per row; sections and tables of
+// other contracts are skipped.
+
+#include <cristaltoken.hpp>
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace eosio;
+
+namespace {
+
+   constexpr uint32_t snapshot_magic       = 0x30510550;
+   constexpr uint64_t snapshot_end_marker  = std::numeric_limits<uint64_t>::max();
+
+   // Read only mapping of a whole file.
+   class mapped_file {
+      public:
+         explicit mapped_file( const char* path ) {
+            _fd = ::open( path, O_RDONLY );
+            check( _fd >= 0, "cannot open snapshot file" );
+            struct stat st;
+            check( ::fstat( _fd, &st ) == 0, "cannot stat snapshot file" );
+            _size = st.st_size;
+            check( _size > 0, "snapshot file is empty" );
+            void* data = ::mmap( nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0 );
+            check( data != MAP_FAILED, "cannot map snapshot file" );
+            ::madvise( data, _size, MADV_SEQUENTIAL );
+            _data = static_cast<const char*>( data );
+         }
+         ~mapped_file() {
+            if( _data ) ::munmap( const_cast<char*>( _data ), _size );
+            if( _fd >= 0 ) ::close( _fd );
+         }
+         mapped_file( const mapped_file& ) = delete;
+         mapped_file& operator=( const mapped_file& ) = delete;
+
+         const char* data()const { return _data; }
+         std::size_t size()const { return _size; }
+
+      private:
+         int          _fd   = -1;
+         const char*  _data = nullptr;
+         std::size_t  _size = 0;
+   };
+
+   // Buffered CSV output: a row is formatted in place and written with one fwrite.
+   class csv_file {
+      public:
+         csv_file( const std::string& path, const char* header ) {
+            _out = std::fopen( path.c_str(), "w" );
+            check( _out != nullptr, "cannot create csv file" );
+            std::setvbuf( _out, nullptr, _IOFBF, 1 << 20 );
+            std::fputs( header, _out );
+            std::fputc( '\n', _out );
+         }
+         ~csv_file() { if( _out ) std::fclose( _out ); }
+         csv_file( const csv_file& ) = delete;
+         csv_file& operator=( const csv_file& ) = delete;
+
+         csv_file& operator<<( const name& n )          { return put_with( [&]( char* b, char* e ) { return n.write_as_string( b, e ); } ); }
+         csv_file& operator<<( const symbol_code& s )   { return put_with( [&]( char* b, char* e ) { return s.write_as_string( b, e ); } ); }
+         csv_file& operator<<( const asset& a )         { return put_with( [&]( char* b, char* e ) { return a.write_as_string( b, e ); } ); }
+         csv_file& operator<<( const time_point_sec& t ){ return *this << t.sec_since_epoch(); }
+
+         template<typename Int>
+         csv_file& operator<<( Int v ) {
+            static_assert( std::is_integral_v<Int> );
+            return put_with( [&]( char* b, char* e ) { return std::to_chars( b, e, +v ).ptr; } );
+         }
+
+         void end_row() {
+            if( _pos > _row ) --_pos;  // trailing comma
+            *_pos++ = '\n';
+            std::fwrite( _row, 1, _pos - _row, _out );
+            _pos = _row;
+            ++_rows;
+         }
+
+         uint64_t rows()const { return _rows; }
+
+      private:
+         template<typename Write>
+         csv_file& put_with( Write&& write ) {
+            char* end = write( _pos, _row + sizeof(_row) - 2 );
+            check( end < _row + sizeof(_row) - 1, "csv row too long" );
+            _pos = end;
+            *_pos++ = ',';
+            return *this;
+         }
+
+         std::FILE*  _out = nullptr;
+         char        _row[512];
+         char*       _pos = _row;
+         uint64_t    _rows = 0;
+   };
+
+   // One output per decoded table; each unpacks into a row object reused for every row.
+   class table_writers {
+      public:
+         explicit table_writers( const std::string& dir )
+            : _accounts( dir + "/accounts.csv", "owner,balance" ),
+              _stat( dir + "/stat.csv", "scope,supply,max_supply,issuer" ),
+              _customers( dir + "/customers.csv", "scope,key,layout,fee,overdraft,account_type,state,flags" ),
+              _customer( dir + "/customer.csv", "scope,key,fee,overdraft,account_type,state" ),
+              _feepool( dir + "/feepool.csv", "scope,accrued" ),
+              _paps( dir + "/paps.csv", "scope,id,layout,account,provider,service_id,price,begins_at,periods,last_charged,flags,disabled_at" ),
+              _pap( dir + "/pap.csv", "scope,id,account,provider,service_id,price,begins_at,periods,last_charged,enabled" ) {}
+
+         // Token of the amounts of packed `customers` rows (see cristaltoken::customer_token).
+         void set_token( const symbol& token ) { _token = token; }
+
+         // Decodes `value` as a row of `table`; rows of other tables are ignored.
+         void write( name table, uint64_t scope, datastream<const char*>& value ) {
+            switch( table.value ) {
+               case "accounts"_n.value:
+                  value >> _account_row;
+                  _accounts << name( scope ) << _account_row.balance;
+                  _accounts.end_row();
+                  break;
+               case "stat"_n.value:
+                  value >> _stats_row;
+                  _stat << symbol_code( scope ) << _stats_row.supply << _stats_row.max_supply << _stats_row.issuer;
+                  _stat.end_row();
+                  break;
+               case "customers"_n.value: {
+                  value >> _customer_row;
+                  // Rows of every layout are shown alike; `layout` is the one stored.
+                  auto c = _customer_row.view( _token );
+                  _customers << name( scope ) << c.key << _customer_row.data.index() << c.fee << c.overdraft
+                             << c.account_type << c.state << c.flags;
+                  _customers.end_row();
+                  break;
+               }
+               case "customer"_n.value:
+                  value >> _legacy_customer_row;
+                  _customer << name( scope ) << _legacy_customer_row.key << _legacy_customer_row.fee << _legacy_customer_row.overdraft
+                            << _legacy_customer_row.account_type << _legacy_customer_row.state;
+                  _customer.end_row();
+                  break;
+               case "feepool"_n.value:
+                  value >> _feepool_row;
+                  _feepool << name( scope ) << _feepool_row.accrued;
+                  _feepool.end_row();
+                  break;
+               case "paps"_n.value: {
+                  value >> _pap_row;
+                  auto p = _pap_row.view();
+                  _paps << name( scope ) << p.id << _pap_row.data.index() << p.account << p.provider << p.service_id
+                        << p.price << p.begins_at << p.periods << p.last_charged << p.flags << p.disabled_at;
+                  _paps.end_row();
+                  break;
+               }
+               case "pap"_n.value:
+                  value >> _legacy_pap_row;
+                  _pap << name( scope ) << _legacy_pap_row.id << _legacy_pap_row.account << _legacy_pap_row.provider
+                       << _legacy_pap_row.service_id << _legacy_pap_row.price << _legacy_pap_row.begins_at
+                       << _legacy_pap_row.periods << _legacy_pap_row.last_charged << _legacy_pap_row.enabled;
+                  _pap.end_row();
+                  break;
+            }
+         }
+
+         void summary()const {
+            std::printf( "accounts=%llu stat=%llu customers=%llu customer=%llu feepool=%llu paps=%llu pap=%llu\n",
+                         (unsigned long long)_accounts.rows(), (unsigned long long)_stat.rows(),
+                         (unsigned long long)_customers.rows(), (unsigned long long)_customer.rows(),
+                         (unsigned long long)_feepool.rows(),
+                         (unsigned long long)_paps.rows(), (unsigned long long)_pap.rows() );
+         }
+
+      private:
+         csv_file _accounts, _stat, _customers, _customer, _feepool, _paps, _pap;
+         symbol   _token;
+
+         cristaltoken::account_row         _account_row;
+         cristaltoken::currency_stats_row  _stats_row;
+         cristaltoken::customer_row        _customer_row;
+         cristaltoken::legacy_customer_row _legacy_customer_row;
+         cristaltoken::feepool_row         _feepool_row;
+         cristaltoken::pap_row             _pap_row;
+         cristaltoken::legacy_pap_row      _legacy_pap_row;
+   };
+
+   // Secondary index rows of the `contract_tables` section, in the order nodeos writes
+   // them after every table: (primary_key, payer, secondary_key) with keys of
+   // uint64, uint128, 256 bits, double and long double.
+   constexpr std::size_t secondary_row_sizes[] = { 8+8+8, 8+8+16, 8+8+32, 8+8+8, 8+8+16 };
+
+   // contract_tables: every table is a table_id row (code, scope, table, payer, count), the
+   // count of its primary rows (primary_key, payer, packed value) and those rows, then the
+   // count and rows of each secondary index kind. Tables come in table_id creation order.
+   // Calls on_row( table, scope, value ) for every primary row of `contract`.
+   template<typename OnRow>
+   void walk_contract_tables( datastream<const char*> ds, name contract, OnRow&& on_row ) {
+      while( ds.remaining() > 0 ) {
+         uint64_t code = 0, scope = 0, table = 0, payer = 0;
+         uint32_t count = 0;
+         ds >> code >> scope >> table >> payer >> count;
+
+         const bool wanted = code == contract.value;
+         auto rows = native::read_varuint32( ds );
+         for( uint32_t i = 0; i < rows; ++i ) {
+            uint64_t primary_key = 0, row_payer = 0;
+            ds >> primary_key >> row_payer;
+            auto size = native::read_varuint32( ds );
+            if( wanted ) {
+               datastream<const char*> value( ds.pos(), size );
+               on_row( name( table ), scope, value );
+            }
+            ds.skip( size );
+         }
+         for( auto row_size : secondary_row_sizes )
+            ds.skip( std::size_t( native::read_varuint32( ds ) ) * row_size );
+      }
+   }
+
+   // Portable snapshot: magic, version, then sections of (size, row count, name, rows)
+   // up to an end marker; `size` counts the bytes that follow it.
+   void decode_snapshot( const mapped_file& file, name contract, table_writers& out ) {
+      datastream<const char*> ds( file.data(), file.size() );
+      uint32_t magic = 0, version = 0;
+      ds >> magic >> version;
+      check( magic == snapshot_magic, "not a nodeos snapshot (bad magic number)" );
+
+      bool found = false;
+      while( true ) {
+         uint64_t section_size = 0;
+         ds >> section_size;
+         if( section_size == snapshot_end_marker )
+            break;
+         check( section_size >= sizeof(uint64_t) && section_size <= ds.remaining(), "corrupted snapshot section" );
+         datastream<const char*> section( ds.pos(), section_size );
+         ds.skip( section_size );
+
+         uint64_t row_count = 0;
+         section >> row_count;
+         const char* section_name = section.pos();
+         auto name_size = strnlen( section_name, section.remaining() );
+         check( name_size < section.remaining(), "corrupted snapshot section name" );
+         section.skip( name_size + 1 );
+
+         if( std::strcmp( section_name, "contract_tables" ) == 0 ) {
+            // `config` may come after `customers`: read the token first.
+            symbol token;
+            walk_contract_tables( section, contract, [&]( name table, uint64_t scope, datastream<const char*>& value ) {
+               if( table == "config"_n && scope == contract.value ) {
+                  cristaltoken::config_row config;
+                  value >> config;
+                  token = config.token;
+               }
+            });
+            out.set_token( token );
+            walk_contract_tables( section, contract, [&]( name table, uint64_t scope, datastream<const char*>& value ) {
+               out.write( table, scope, value );
+            });
+            found = true;
+         }
+      }
+      check( found, "snapshot has no contract_tables section" );
+   }
+
+} /// namespace
+
+int main( int argc, char** argv ) {
+   if( argc < 3 || argc > 4 ) {
+      std::fprintf( stderr, "usage: %s <snapshot.bin> <contract account> [output directory]\n", argv[0] );
+      return 2;
+   }
+   try {
+      mapped_file file( argv[1] );
+      table_writers out( argc == 4 ? argv[3] : "." );
+      decode_snapshot( file, name( std::string_view( argv[2] ) ), out );
+      out.summary();
+   } catch( const std::exception& e ) {
+      std::fprintf( stderr, "error: %s\n", e.what() );
+      return 1;
+   }
+   return 0;
+}
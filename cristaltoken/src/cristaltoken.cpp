@@ -1,5 +1,7 @@
 #include <cristaltoken.hpp>
 
+#include <algorithm>
+
 namespace eosio {
 
   void cristaltoken::create( const name&   issuer,
@@ -8,150 +10,362 @@ namespace eosio {
       require_auth( get_self() );
 
       auto sym = maximum_supply.symbol;
-      check( sym.is_valid(), "invalid symbol name" );
-      check( maximum_supply.is_valid(), "invalid supply");
-      check( maximum_supply.amount > 0, "max-supply must be positive");
+      check( sym.is_valid(), ERR_INVALID_SYMBOL, "invalid symbol name" );
+      check( maximum_supply.is_valid(), ERR_INVALID_SUPPLY, "invalid supply" );
+      check( maximum_supply.amount > 0, ERR_MAX_SUPPLY_NOT_POSITIVE, "max-supply must be positive" );
 
-      stats statstable( get_self(), sym.code().raw() );
+      auto& statstable = _cache.stats_of( sym.code() );
       auto existing = statstable.find( sym.code().raw() );
-      check( existing == statstable.end(), "token with symbol already exists" );
+      check( existing == statstable.end(), ERR_TOKEN_EXISTS, "token with symbol already exists" );
 
       statstable.emplace( get_self(), [&]( auto& s ) {
          s.supply.symbol = maximum_supply.symbol;
          s.max_supply    = maximum_supply;
          s.issuer        = issuer;
       });
+
+      auto& cfg = _cache.config_table();
+      auto row = cfg.get_or_default();
+      if( !row.has_token() ) {
+        row.token = maximum_supply.symbol;
+        cfg.set( row, get_self() );
+      }
+  }
+
+  void cristaltoken::setconfig( const symbol& token )
+  {
+      require_auth( get_self() );
+
+      auto& statstable = _cache.stats_of( token.code() );
+      auto existing = statstable.find( token.code().raw() );
+      check( existing != statstable.end(), ERR_TOKEN_NOT_FOUND, "symbol does not exist" );
+      const auto& st = *existing;
+      check( st.supply.symbol == token, ERR_SYMBOL_PRECISION_MISMATCH, "symbol precision mismatch" );
+
+      // Packed customer rows hold amounts of the contract token (see customer_v2).
+      auto& cfg = _cache.config_table();
+      auto row = cfg.get_or_default();
+      check( !row.has_token() || row.token == token, ERR_CONTRACT_TOKEN_SET, "contract token already set" );
+      row.token = token;
+      cfg.set( row, get_self() );
   }
 
 
   void cristaltoken::issue( const name& to, const asset& quantity, const string& memo )
+  {
+      issue_impl( to, quantity, memo );
+  }
+
+  void cristaltoken::issue_impl( const name& to, const asset& quantity, const string& memo )
   {
       auto sym = quantity.symbol;
-      check( sym.is_valid(), "invalid symbol name" );
-      check( memo.size() <= 256, "memo has more than 256 bytes" );
+      check( sym.is_valid(), ERR_INVALID_SYMBOL, "invalid symbol name" );
+      check( memo.size() <= 256, ERR_MEMO_TOO_LONG, "memo has more than 256 bytes" );
 
-      stats statstable( get_self(), sym.code().raw() );
+      auto& statstable = _cache.stats_of( sym.code() );
       auto existing = statstable.find( sym.code().raw() );
-      check( existing != statstable.end(), "token with symbol does not exist, create token before issue" );
+      check( existing != statstable.end(), ERR_TOKEN_NOT_FOUND, "token with symbol does not exist, create token before issue" );
       const auto& st = *existing;
       // HACK
       // check( to == st.issuer, "tokens can only be issued to issuer account" );
 
       require_auth( st.issuer );
-      check( quantity.is_valid(), "invalid quantity" );
-      check( quantity.amount > 0, "must issue positive quantity" );
+      check( quantity.is_valid(), ERR_INVALID_QUANTITY, "invalid quantity" );
+      check( quantity.amount > 0, ERR_ISSUE_NOT_POSITIVE, "must issue positive quantity" );
 
-      check( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
-      check( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
+      check( quantity.symbol == st.supply.symbol, ERR_SYMBOL_PRECISION_MISMATCH, "symbol precision mismatch" );
+      check( quantity.amount <= st.max_supply.amount - st.supply.amount, ERR_SUPPLY_EXCEEDED, "quantity exceeds available supply" );
 
       statstable.modify( st, same_payer, [&]( auto& s ) {
          s.supply += quantity;
       });
 
-      // HACK
-      // add_balance( st.issuer, quantity, st.issuer );
-      add_balance( st.issuer, quantity, st.issuer );
+      // `to` is credited directly instead of crediting the issuer and transferring it from
+      // there. The inline transfer is still sent, as a record: transfer consumers see the
+      // same issuer-to-`to` transfer, and `to` is notified by it.
+      if( to != st.issuer )
+        check( is_account( to ), ERR_TO_ACCOUNT_NOT_FOUND, "to account does not exist" );
+      add_balance( to, quantity, st.issuer );
 
       if( to != st.issuer ) {
         SEND_INLINE_ACTION( *this, transfer, { {st.issuer, "active"_n} },
                             { st.issuer, to, quantity, memo }
         );
       }
-
   }
 
   void cristaltoken::retire( const asset& quantity, const string& memo )
   {
       auto sym = quantity.symbol;
-      check( sym.is_valid(), "invalid symbol name" );
-      check( memo.size() <= 256, "memo has more than 256 bytes" );
+      check( sym.is_valid(), ERR_INVALID_SYMBOL, "invalid symbol name" );
+      check( memo.size() <= 256, ERR_MEMO_TOO_LONG, "memo has more than 256 bytes" );
 
-      stats statstable( get_self(), sym.code().raw() );
+      auto& statstable = _cache.stats_of( sym.code() );
       auto existing = statstable.find( sym.code().raw() );
-      check( existing != statstable.end(), "token with symbol does not exist" );
+      check( existing != statstable.end(), ERR_TOKEN_NOT_FOUND, "token with symbol does not exist" );
       const auto& st = *existing;
 
       require_auth( st.issuer );
-      check( quantity.is_valid(), "invalid quantity" );
-      check( quantity.amount > 0, "must retire positive quantity" );
+      check( quantity.is_valid(), ERR_INVALID_QUANTITY, "invalid quantity" );
+      check( quantity.amount > 0, ERR_RETIRE_NOT_POSITIVE, "must retire positive quantity" );
 
-      check( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
+      check( quantity.symbol == st.supply.symbol, ERR_SYMBOL_PRECISION_MISMATCH, "symbol precision mismatch" );
 
       statstable.modify( st, same_payer, [&]( auto& s ) {
          s.supply -= quantity;
       });
 
-      sub_balance( st.issuer, quantity );
+      // Only tokens the issuer holds can be retired: a credit line would take the supply
+      // below zero.
+      sub_balance( st.issuer, quantity, 0 );
   }
 
-  void cristaltoken::transfer( const name&    from,
+  cristaltoken::transfer_result cristaltoken::transfer( const name&    from,
                         const name&    to,
                         const asset&   quantity,
                         const string&  memo )
   {
-      
+      // Record of an issue, only the contract can send it (see issue_impl).
+      if( get_sender() == get_self() ) {
+        require_recipient( from, to );
+        return { balance_of( from, quantity.symbol ), balance_of( to, quantity.symbol ) };
+      }
+
       require_auth( from );
-      transfer_impl( from, to, quantity, memo );
+      return transfer_impl( from, to, quantity, memo, false );
   }
 
-  void cristaltoken::sub_balance( const name& owner, const asset& value ) {
-     accounts from_acnts( get_self(), owner.value );
+  cristaltoken::transfer_result cristaltoken::xfer( const name&      from,
+                                                    const name&      to,
+                                                    const int64_t&   amount,
+                                                    const uint64_t&  ref )
+  {
+      require_auth( from );
+      auto token = _cache.config_table().get_or_default().token;
+      check( token.raw() != 0, ERR_CONTRACT_TOKEN_NOT_SET, "contract token not set" );
+      // `ref` is only meant to be read from the action data.
+      return transfer_impl( from, to, asset( amount, token ), string(), false );
+  }
+
+  void cristaltoken::transferbatch( const name&                 from,
+                                    const std::vector<payout>&  payouts )
+  {
+      require_auth( from );
+      check( !payouts.empty(), ERR_NO_PAYOUTS, "no payouts to transfer" );
+
+      auto sym = payouts.front().quantity.symbol;
+      check( sym.is_valid(), ERR_INVALID_SYMBOL, "invalid symbol name" );
+      auto& statstable = _cache.stats_of( sym.code() );
+      auto existing = statstable.find( sym.code().raw() );
+      check( existing != statstable.end(), ERR_TOKEN_NOT_FOUND, "token with symbol does not exist" );
+      const auto& st = *existing;
+      check( sym == st.supply.symbol, ERR_SYMBOL_PRECISION_MISMATCH, "symbol precision mismatch" );
+
+      auto from_customer = find_customer( from );
+      auto fee = customer_fee( from_customer, sym );
+      asset total( 0, sym );
+      asset fees( 0, sym );
+      for( const auto& p : payouts ) {
+        check( from != p.to, ERR_TRANSFER_TO_SELF, "cannot transfer to self" );
+        check( is_account( p.to ), ERR_TO_ACCOUNT_NOT_FOUND, "to account does not exist" );
+        check( p.quantity.is_valid(), ERR_INVALID_QUANTITY, "invalid quantity" );
+        check( p.quantity.amount > 0, ERR_TRANSFER_NOT_POSITIVE, "must transfer positive quantity" );
+        check( p.quantity.symbol == sym, ERR_SYMBOL_PRECISION_MISMATCH, "symbol precision mismatch" );
+        check( p.memo.size() <= 256, ERR_MEMO_TOO_LONG, "memo has more than 256 bytes" );
+        total += p.quantity;
+        fees  += fee;
+      }
+
+      require_recipient( from );
+      sub_balance( from, total + fees, credit_limit( from_customer, sym ) );
+      if( fees.amount > 0 )
+        accrue_fee( fees );
+
+      // Payouts of the bank are bank initiated: payees that opted out are not notified.
+      const bool by_bank = from == get_self() || ( from_customer && from_customer->account_type == TYPE_ACCOUNT_BANK_ADMIN );
+      for( const auto& p : payouts ) {
+        if( !by_bank || notified( find_customer( p.to ) ) )
+          require_recipient( p.to );
+        add_balance( p.to, p.quantity, get_self() );
+      }
+  }
+
+  // Balance of `owner` in `sym`, zero without a balance row.
+  asset cristaltoken::balance_of( const name& owner, const symbol& sym ) {
+     auto& acnts = _cache.accounts_of( owner );
+     auto it = acnts.find( sym.code().raw() );
+     return it == acnts.end() ? asset( 0, sym ) : it->balance;
+  }
 
-     const auto& from = from_acnts.get( value.symbol.code().raw(), "no balance object found" );
-     check( from.balance.amount >= value.amount, "overdrawn balance" );
+  // `credit` is how far below zero the balance may go (see credit_limit); without a balance
+  // row the balance starts from zero.
+  asset cristaltoken::sub_balance( const name& owner, const asset& value, const int64_t& credit ) {
+     auto& from_acnts = _cache.accounts_of( owner );
+
+     auto from = from_acnts.find( value.symbol.code().raw() );
+     if( from == from_acnts.end() ) {
+        check( credit > 0, ERR_BALANCE_NOT_FOUND, "no balance object found" );
+        check( value.amount <= credit, ERR_OVERDRAWN_BALANCE, "overdrawn balance" );
+        from_acnts.emplace( get_self(), [&]( auto& a ){
+          a.balance = -value;
+        });
+        register_holder( owner, value.symbol.code(), get_self() );
+        audit_moved( owner, -value );
+        return -value;
+     }
+     if( from->balance.amount < value.amount )
+        check( from->balance.amount - value.amount >= -credit, ERR_OVERDRAWN_BALANCE, "overdrawn balance" );
 
      // from_acnts.modify( from, owner, [&]( auto& a ) {
      from_acnts.modify( from, get_self(), [&]( auto& a ) {
            a.balance -= value;
         });
+     audit_moved( owner, -value );
+     return from->balance;
   }
 
-  void cristaltoken::add_balance( const name& owner, const asset& value, const name& ram_payer )
+  asset cristaltoken::add_balance( const name& owner, const asset& value, const name& ram_payer )
   {
-     accounts to_acnts( get_self(), owner.value );
+     auto& to_acnts = _cache.accounts_of( owner );
      auto to = to_acnts.find( value.symbol.code().raw() );
      if( to == to_acnts.end() ) {
         // to_acnts.emplace( ram_payer, [&]( auto& a ){
         to_acnts.emplace( get_self(), [&]( auto& a ){
           a.balance = value;
         });
-     } else {
-        // to_acnts.modify( to, same_payer, [&]( auto& a ) {
-        to_acnts.modify( to, get_self(), [&]( auto& a ) {
-          a.balance += value;
+        register_holder( owner, value.symbol.code(), get_self() );
+        audit_moved( owner, value );
+        return value;
+     }
+     // to_acnts.modify( to, same_payer, [&]( auto& a ) {
+     to_acnts.modify( to, get_self(), [&]( auto& a ) {
+       a.balance += value;
+     });
+     audit_moved( owner, value );
+     return to->balance;
+  }
+
+  void cristaltoken::register_holder( const name& owner, const symbol_code& sym, const name& ram_payer )
+  {
+     auto& holder_list = _cache.holders_of( sym );
+     if( holder_list.find( owner.value ) == holder_list.end() ) {
+        holder_list.emplace( ram_payer, [&]( auto& h ){
+          h.owner = owner;
         });
      }
   }
 
+  // Keeps the running sum of an unfinished audit exact: the balance of a holder already
+  // summed changed by `delta` (holders not summed yet are read when the walk reaches them).
+  // The audit state is looked up once per action and token, running or not.
+  void cristaltoken::audit_moved( const name& owner, const asset& delta )
+  {
+     auto& state = _cache.audit_state( delta.symbol.code() );
+     if( !state || owner.value >= state->next.value )
+        return;
+     state->balances += delta;
+     _cache.audits_of( delta.symbol.code() ).set( *state, get_self() );
+  }
+
   void cristaltoken::open( const name& owner, const symbol& symbol, const name& ram_payer )
   {
      require_auth( ram_payer );
 
-     check( is_account( owner ), "owner account does not exist" );
+     check( is_account( owner ), ERR_OWNER_ACCOUNT_NOT_FOUND, "owner account does not exist" );
 
      auto sym_code_raw = symbol.code().raw();
-     stats statstable( get_self(), sym_code_raw );
-     const auto& st = statstable.get( sym_code_raw, "symbol does not exist" );
-     check( st.supply.symbol == symbol, "symbol precision mismatch" );
+     auto& statstable = _cache.stats_of( symbol.code() );
+     auto existing = statstable.find( sym_code_raw );
+     check( existing != statstable.end(), ERR_TOKEN_NOT_FOUND, "symbol does not exist" );
+     const auto& st = *existing;
+     check( st.supply.symbol == symbol, ERR_SYMBOL_PRECISION_MISMATCH, "symbol precision mismatch" );
 
-     accounts acnts( get_self(), owner.value );
+     auto& acnts = _cache.accounts_of( owner );
      auto it = acnts.find( sym_code_raw );
      if( it == acnts.end() ) {
         acnts.emplace( ram_payer, [&]( auto& a ){
         // acnts.emplace( get_self(), [&]( auto& a ){
           a.balance = asset{0, symbol};
         });
+        register_holder( owner, symbol.code(), ram_payer );
      }
   }
 
   void cristaltoken::close( const name& owner, const symbol& symbol )
   {
      require_auth( owner );
-     accounts acnts( get_self(), owner.value );
+     auto& acnts = _cache.accounts_of( owner );
      auto it = acnts.find( symbol.code().raw() );
-     check( it != acnts.end(), "Balance row already deleted or never existed. Action won't have any effect." );
-     check( it->balance.amount == 0, "Cannot close because the balance is not zero." );
+     check( it != acnts.end(), ERR_BALANCE_NOT_FOUND, "Balance row already deleted or never existed. Action won't have any effect." );
+     check( it->balance.amount == 0, ERR_BALANCE_NOT_ZERO, "Cannot close because the balance is not zero." );
      acnts.erase( it );
+
+     // Rows opened before the holders registry existed may not be registered.
+     auto& holder_list = _cache.holders_of( symbol.code() );
+     auto holder = holder_list.find( owner.value );
+     if( holder != holder_list.end() )
+        holder_list.erase( holder );
+  }
+
+  cristaltoken::audit_result cristaltoken::audit( const symbol_code& sym, const uint32_t& max_rows )
+  {
+     require_auth( get_self() );
+     check( max_rows > 0, ERR_MAX_ROWS_NOT_POSITIVE, "max_rows must be positive" );
+
+     auto& statstable = _cache.stats_of( sym );
+     auto existing = statstable.find( sym.raw() );
+     check( existing != statstable.end(), ERR_TOKEN_NOT_FOUND, "token with symbol does not exist" );
+     const auto& st = *existing;
+
+     auto& audits = _cache.audits_of( sym );
+     auto& running = _cache.audit_state( sym );
+     auto state = running.value_or( auditstate{ name(), 0, asset( 0, st.supply.symbol ) } );
+
+     auto& holder_list = _cache.holders_of( sym );
+     auto it = holder_list.lower_bound( state.next.value );
+     for( uint32_t rows = 0; it != holder_list.end() && rows < max_rows; ++it, ++rows ) {
+        auto& acnts = _cache.accounts_of( it->owner );
+        auto balance = acnts.find( sym.raw() );
+        if( balance != acnts.end() )
+           state.balances += balance->balance;
+        ++state.holders;
+     }
+
+     audit_result result{ it == holder_list.end(), state.holders, state.balances, asset( 0, st.supply.symbol ), st.supply, false };
+     if( !result.done ) {
+        state.next = it->owner;
+        running = state;
+        audits.set( state, get_self() );
+        return result;
+     }
+
+     auto& pool = _cache.feepools_table();
+     auto fees = pool.find( sym.raw() );
+     if( fees != pool.end() )
+        result.fees = fees->accrued;
+     result.balanced = result.balances + result.fees == result.supply;
+     running.reset();
+     audits.remove();
+     return result;
+  }
+
+  void cristaltoken::regholders( const symbol_code& sym, const std::vector<name>& owners )
+  {
+     require_auth( get_self() );
+
+     auto& holder_list = _cache.holders_of( sym );
+     for( const auto& owner : owners ) {
+        auto& acnts = _cache.accounts_of( owner );
+        auto balance = acnts.find( sym.raw() );
+        check( balance != acnts.end(), ERR_BALANCE_NOT_FOUND, "no balance object found" );
+        if( holder_list.find( owner.value ) != holder_list.end() )
+           continue;
+        holder_list.emplace( get_self(), [&]( auto& h ){
+          h.owner = owner;
+        });
+        // A running audit may already be past `owner`.
+        audit_moved( owner, balance->balance );
+     }
   }
 
   void cristaltoken::upsertpap(const name&      from
@@ -166,72 +380,70 @@ namespace eosio {
   {
 
       // require_auth(get_self());
-      customers customers_idx(get_self(), get_first_receiver().value);
-      auto iter_account = customers_idx.find(from.value);
+      auto iter_account = find_customer(from);
       
-      check( iter_account != customers_idx.end(), "Customer account not exists." );
-      check( memo.size() <= 256, "memo has more than 256 bytes" );
+      check( iter_account.has_value(), ERR_CUSTOMER_NOT_FOUND, "Customer account not exists." );
+      check( memo.size() <= 256, ERR_MEMO_TOO_LONG, "memo has more than 256 bytes" );
       
-      auto iter_account_obj = iter_account;
+      auto& iter_account_obj = iter_account;
       
-      check( iter_account_obj->state == STATE_ENABLED, "Customer account is not enabled." );
+      check( iter_account_obj->state == STATE_ENABLED, ERR_CUSTOMER_NOT_ENABLED, "Customer account is not enabled." );
 
-      auto iter_provider = customers_idx.find(to.value);
-      check( iter_provider != customers_idx.end(), "Provider account not exists." );
+      auto iter_provider = find_customer(to);
+      check( iter_provider.has_value(), ERR_PROVIDER_NOT_FOUND, "Provider account not exists." );
       // auto& iter_provider_obj = *iter_provider;
-      auto iter_provider_obj = iter_provider;
-      check( iter_provider_obj->state == STATE_ENABLED, "Provider account is not enabled." );
-      check( iter_provider_obj->account_type == TYPE_ACCOUNT_BUSINESS || iter_provider_obj->account_type == TYPE_ACCOUNT_BANK_ADMIN, "Provider account is not BIZ neither ADMIN." );
-
-      auto idxKey = pap::_by_account_service_provider(from, to, service_id);
-      paps pap_list(get_self(), get_first_receiver().value);
-      auto cidx = pap_list.get_index<"byall"_n>();
-      auto it = cidx.find(idxKey);
-      if( it == cidx.end())
+      auto& iter_provider_obj = iter_provider;
+      check( iter_provider_obj->state == STATE_ENABLED, ERR_PROVIDER_NOT_ENABLED, "Provider account is not enabled." );
+      check( iter_provider_obj->account_type == TYPE_ACCOUNT_BUSINESS || iter_provider_obj->account_type == TYPE_ACCOUNT_BANK_ADMIN, ERR_PROVIDER_TYPE, "Provider account is not BIZ neither ADMIN." );
+
+      auto& pap_list = _cache.paps_table();
+      auto it = find_pap(pap_list, from, to, service_id);
+      if( it == pap_list.end())
       {
         require_auth( from );
 
-        check(to != from, "Customer and provider should be different accounts");
-        check( periods>0, "periods is less than 1" );
+        check(to != from, ERR_PAP_SAME_ACCOUNTS, "Customer and provider should be different accounts" );
+        check( periods>0, ERR_PAP_PERIODS_NOT_POSITIVE, "periods is less than 1" );
+        check( periods <= std::numeric_limits<uint16_t>::max(), ERR_PAP_PERIODS_TOO_LARGE, "periods is too large" );
 
 
         auto sym = price.symbol;
-        check( sym.is_valid(), "invalid price symbol name" );
-        stats statstable( get_self(), sym.code().raw() );
+        check( sym.is_valid(), ERR_PAP_INVALID_PRICE_SYMBOL, "invalid price symbol name" );
+        auto& statstable = _cache.stats_of( sym.code() );
         auto existing = statstable.find( sym.code().raw() );
-        check( existing != statstable.end(), "price token symbol does not exist" );
+        check( existing != statstable.end(), ERR_PAP_PRICE_TOKEN_NOT_FOUND, "price token symbol does not exist" );
         const auto& st = *existing;
-        check( price.is_valid(), "invalid price quantity" );
-        check( price.amount > 0, "must set positive price quantity" );
-        check( price.symbol == st.supply.symbol, "price symbol precision mismatch" );
+        check( price.is_valid(), ERR_PAP_INVALID_PRICE, "invalid price quantity" );
+        check( price.amount > 0, ERR_PAP_PRICE_NOT_POSITIVE, "must set positive price quantity" );
+        check( price.symbol == st.supply.symbol, ERR_PAP_PRICE_PRECISION, "price symbol precision mismatch" );
         
         pap_list.emplace(get_self(), [&]( auto& row ) {
-          row.id              = pap_list.available_primary_key();
+          row.id              = next_pap_id(pap_list);
           row.account         = from; //account;
           row.provider        = to;   //provider;
           row.service_id      = service_id;
-          row.price           = price;
-          row.begins_at       = time_point_sec(begins_at);
-          row.periods         = periods;
-          row.last_charged    = 0;
-          row.enabled         = STATE_ENABLED;
-
-          // row.provider_account          = row.by_provider_account();
-          // row.account_service           = row.by_account_service();
-          // row.provider_service          = row.by_provider_service();
-          // row.account_service_provider  = row.by_account_service_provider();
-
+          row.set({ row.id, from, to, service_id, price, time_point_sec(begins_at), uint16_t(periods), 0,
+                    PAP_FLAG_ENABLED, time_point_sec() });
         });
 
       }
       else {
         
-        check( has_auth(get_self()) || has_auth(to), "Missing required authority of admin or provider");
-        check( enabled==STATE_ENABLED || enabled==STATE_BLOCKED, "Invalid enabled argument.");
+        check( has_auth(get_self()) || has_auth(to), ERR_MISSING_ADMIN_OR_PROVIDER, "Missing required authority of admin or provider" );
+        check( enabled==STATE_ENABLED || enabled==STATE_BLOCKED, ERR_PAP_INVALID_ENABLED, "Invalid enabled argument." );
         
-        // cidx.modify(it, same_payer, [&]( auto& row ) {  
-        cidx.modify(it, get_self(), [&]( auto& row ) {
-          row.enabled           = enabled;
+        // pap_list.modify(it, same_payer, [&]( auto& row ) {  
+        pap_list.modify(it, get_self(), [&]( auto& row ) {
+          auto pap = row.view();
+          if( enabled == STATE_ENABLED ) {
+            pap.flags |= PAP_FLAG_ENABLED;
+            pap.disabled_at = time_point_sec();
+          }
+          else if( pap.enabled() ) {
+            pap.flags &= ~PAP_FLAG_ENABLED;
+            pap.disabled_at = now();
+          }
+          row.set(pap);
         });
       }
 
@@ -242,45 +454,65 @@ namespace eosio {
                               , const uint32_t&   service_id
                               , const string& memo) {
       
-      check( has_auth(get_self()) || has_auth(to), "Missing required authority of admin or provider");
-      check( memo.size() <= 256, "memo has more than 256 bytes" );
+      check( has_auth(get_self()) || has_auth(to), ERR_MISSING_ADMIN_OR_PROVIDER, "Missing required authority of admin or provider" );
+      check( memo.size() <= 256, ERR_MEMO_TOO_LONG, "memo has more than 256 bytes" );
       
-      auto idxKey = pap::_by_account_service_provider(from, to, service_id);
-      paps pap_list(get_self(), get_first_receiver().value);
-      auto cidx = pap_list.get_index<"byall"_n>();
-      auto it = cidx.find(idxKey);
+      auto& pap_list = _cache.paps_table();
+      auto it = find_pap(pap_list, from, to, service_id);
 
-      check( it != cidx.end(), "PAP (Account-Provider-Service) not found");
+      check( it != pap_list.end(), ERR_PAP_NOT_FOUND, "PAP (Account-Provider-Service) not found" );
       
-      cidx.erase(it);
+      move_charge_cursor(*it);
+      pap_list.erase(it);
   }
 
-  void cristaltoken::chargepap(const name&        from
-                              , const name&       to
-                              , const uint32_t&   service_id
-                              , const asset&      quantity
-                              , const string&     memo) {
-      
-    check( memo.size() <= 256, "memo has more than 256 bytes" );
-    check( has_auth(get_self()) || has_auth(to), "Missing required authority of admin or provider");
+  cristaltoken::charge_result cristaltoken::chargepap(const name&        from
+                                                     , const name&       to
+                                                     , const uint32_t&   service_id
+                                                     , const asset&      quantity
+                                                     , const string&     memo) {
+
+    return charge_pap( from, to, service_id, quantity, 1, memo );
+  }
+
+  cristaltoken::charge_result cristaltoken::catchuppap(const name&       from
+                                                     , const name&       to
+                                                     , const uint32_t&   service_id
+                                                     , const asset&      quantity
+                                                     , const uint32_t&   max_periods
+                                                     , const string&     memo) {
+
+    check( max_periods > 0, ERR_PAP_MAX_PERIODS, "max_periods must be positive" );
+    return charge_pap( from, to, service_id, quantity, max_periods, memo );
+  }
+
+  // Charges every period due up to now, at most max_periods of them, with one debit of
+  // `from` and one credit of `to`.
+  cristaltoken::charge_result cristaltoken::charge_pap(const name&       from
+                                                     , const name&       to
+                                                     , const uint32_t&   service_id
+                                                     , const asset&      quantity
+                                                     , const uint32_t&   max_periods
+                                                     , const string&     memo) {
+
+    check( memo.size() <= 256, ERR_MEMO_TOO_LONG, "memo has more than 256 bytes" );
+    check( has_auth(get_self()) || has_auth(to), ERR_MISSING_ADMIN_OR_PROVIDER, "Missing required authority of admin or provider" );
 
     auto sym = quantity.symbol;
-    check( sym.is_valid(), "invalid symbol name" );
+    check( sym.is_valid(), ERR_INVALID_SYMBOL, "invalid symbol name" );
     
     // Check pap exists
-    auto idxKey = pap::_by_account_service_provider(from, to, service_id);
-    paps pap_list(get_self(), get_first_receiver().value);
-    auto cidx = pap_list.get_index<"byall"_n>();
-    auto it = cidx.find(idxKey);
+    auto& pap_list = _cache.paps_table();
+    auto it = find_pap(pap_list, from, to, service_id);
     
-    check( it != cidx.end(), "PAP (Account-Provider-Service) not found");
+    check( it != pap_list.end(), ERR_PAP_NOT_FOUND, "PAP (Account-Provider-Service) not found" );
     
-    auto& pap = *it;
+    auto pap = it->view();
     
-    check( pap.enabled==STATE_ENABLED, "PAP is not enabled");
-    check( quantity.is_valid(), "invalid quantity" );
-    check( quantity.symbol == pap.price.symbol, "symbol mismatch" );
-    check( quantity.amount == pap.price.amount , "quantity differs from agreed price");
+    check( pap.enabled(), ERR_PAP_NOT_ENABLED, "PAP is not enabled" );
+    check( quantity.is_valid(), ERR_INVALID_QUANTITY, "invalid quantity" );
+    check( quantity.symbol == pap.price.symbol, ERR_PAP_SYMBOL_MISMATCH, "symbol mismatch" );
+    check( quantity.amount == pap.price.amount , ERR_PAP_PRICE_MISMATCH, "quantity differs from agreed price" );
 
 
     time_point_sec current_time       = now();
@@ -288,18 +520,15 @@ namespace eosio {
     
     if ( current_time.sec_since_epoch() < (last_charged_time.sec_since_epoch() + REQUIRED_PERIOD_DURATION))
     {
-      auto remaining = std::floor((( last_charged_time.sec_since_epoch() + REQUIRED_PERIOD_DURATION ) - current_time.sec_since_epoch()) / DAYS_IN_SECONDS);
-      std::string err = "Cannot charge yet, You still have "
-                    + std::to_string( remaining )
-                    + " days remaining";
-
-      check( false, err.c_str());
-    
+      uint32_t remaining = (( last_charged_time.sec_since_epoch() + REQUIRED_PERIOD_DURATION ) - current_time.sec_since_epoch()) / DAYS_IN_SECONDS;
+      check( false, ERR_PAP_NOT_DUE, remaining, "Cannot charge yet, You still have ", " days remaining" );
     }
     
-    auto period = pap.last_charged+1;
+    check( pap.last_charged < pap.periods, ERR_PAP_ENDED, "Sorry, contract has ended!" );
 
-    check( period <= pap.periods, "Sorry, contract has ended!");
+    // Periods started since begins_at, capped by the contract length and max_periods.
+    uint32_t elapsed  = ( current_time.sec_since_epoch() - pap.begins_at.sec_since_epoch() ) / REQUIRED_PERIOD_DURATION;
+    uint32_t period   = std::min<uint64_t>({ elapsed, pap.periods, uint64_t(pap.last_charged) + max_periods });
 
     // action{
     //   permission_level{get_self(), "active"_n},
@@ -311,49 +540,488 @@ namespace eosio {
     //                     { pap.account, pap.provider, pap.price, memo }
     // );
     
-    transfer_impl( pap.account, pap.provider, pap.price, memo );
-
-    auto enabled = 1;
-    if(period == pap.periods)
-      enabled = 0;
-    cidx.modify(it, get_self(), [&]( auto& row ) {
-    // cidx.modify(it, same_payer, [&]( auto& row ) {
-      row.last_charged = period;
-      row.enabled      = enabled; 
+    auto balances = transfer_impl( pap.account, pap.provider, pap.price * ( period - pap.last_charged ), memo, true, period - pap.last_charged );
+
+    // pap_list.modify(it, same_payer, [&]( auto& row ) {
+    pap.last_charged = period;
+    if( period == pap.periods ) {
+      pap.flags &= ~PAP_FLAG_ENABLED;
+      pap.disabled_at = current_time;
+    }
+    pap_list.modify(it, get_self(), [&]( auto& row ) {
+      row.set(pap);
+    });
+
+    // Read before pruning, which may erase the row once its last period is charged.
+    charge_result result{ balances.from_balance, balances.to_balance, pap.last_charged,
+                          uint16_t(pap.periods - pap.last_charged),
+                          time_point_sec(pap.last_charged < pap.periods ? pap.next_charge_at() : 0) };
+
+    prune_paps( PAP_PRUNE_ROWS_PER_CHARGE );
+    return result;
+  }
+
+  void cristaltoken::chargeall(const name&        provider
+                              , const uint32_t&   service_id
+                              , const uint32_t&   max_rows
+                              , const string&     memo) {
+
+    check( memo.size() <= 256, ERR_MEMO_TOO_LONG, "memo has more than 256 bytes" );
+    check( has_auth(get_self()) || has_auth(provider), ERR_MISSING_ADMIN_OR_PROVIDER, "Missing required authority of admin or provider" );
+    check( max_rows > 0, ERR_MAX_ROWS_NOT_POSITIVE, "max_rows must be positive" );
+    check_paps_migrated();
+
+    auto idxKey = pap::_by_provider_service(provider, service_id);
+    auto& pap_list = _cache.paps_table();
+    auto cidx = pap_list.get_index<"byprovserv"_n>();
+    auto it = cidx.lower_bound(idxKey);
+
+    // Resume the previous walk, if any. erasepap and prune_paps move the cursor off the rows
+    // they erase, so it always names a row of the walk; a cursor left on an erased row by an
+    // older contract restarts the walk.
+    chargecursors cursors(get_self(), provider.value);
+    auto cursor = cursors.find(service_id);
+    if( cursor != cursors.end() ) {
+      auto resume = pap_list.find(cursor->next_id);
+      if( resume != pap_list.end() && resume->by_provider_service() == idxKey )
+        it = cidx.iterator_to(*resume);
+    }
+
+    const uint32_t current_time = now().sec_since_epoch();
+    std::vector<asset> charged;
+    std::vector<asset> fees;
+    uint32_t rows = 0;
+    for( ; it != cidx.end() && it->by_provider_service() == idxKey && rows < max_rows; ++it, ++rows )
+    {
+      auto pap = it->view();
+      if( !pap.enabled() || pap.last_charged >= pap.periods || current_time < pap.next_charge_at() )
+        continue;
+
+      // Unfunded subscribers (balance plus credit limit) are skipped instead of failing the whole batch.
+      auto account = find_customer( pap.account );
+      auto fee = customer_fee( account, pap.price.symbol );
+      auto credit = credit_limit( account, pap.price.symbol );
+      auto& from_acnts = _cache.accounts_of( pap.account );
+      auto from = from_acnts.find( pap.price.symbol.code().raw() );
+      auto balance = from == from_acnts.end() ? 0 : from->balance.amount;
+      if( balance + credit < pap.price.amount + fee.amount )
+        continue;
+
+      sub_balance( pap.account, pap.price + fee, credit );
+      if( notified( account ) )
+        require_recipient( pap.account );
+
+      auto total = std::find_if( charged.begin(), charged.end(), [&]( const auto& a ) { return a.symbol == pap.price.symbol; } );
+      if( total == charged.end() )
+        charged.push_back( pap.price );
+      else
+        *total += pap.price;
+
+      if( fee.amount > 0 ) {
+        auto fee_total = std::find_if( fees.begin(), fees.end(), [&]( const auto& a ) { return a.symbol == fee.symbol; } );
+        if( fee_total == fees.end() )
+          fees.push_back( fee );
+        else
+          *fee_total += fee;
+      }
+
+      pap.last_charged += 1;
+      if( pap.last_charged == pap.periods ) {
+        pap.flags &= ~PAP_FLAG_ENABLED;
+        pap.disabled_at = time_point_sec(current_time);
+      }
+      cidx.modify(it, get_self(), [&]( auto& row ) {
+        row.set(pap);
+      });
+    }
+
+    if( it == cidx.end() || it->by_provider_service() != idxKey ) {
+      if( cursor != cursors.end() )
+        cursors.erase(cursor);
+    }
+    else if( cursor == cursors.end() ) {
+      cursors.emplace(get_self(), [&]( auto& row ) {
+        row.service_id = service_id;
+        row.next_id    = it->id;
+      });
+    }
+    else {
+      cursors.modify(cursor, get_self(), [&]( auto& row ) {
+        row.next_id    = it->id;
+      });
+    }
+
+    if( !charged.empty() && notified( find_customer( provider ) ) )
+      require_recipient( provider );
+    for( const auto& total : charged )
+      add_balance( provider, total, get_self() );
+    for( const auto& total : fees )
+      accrue_fee( total );
+  }
+
+  void cristaltoken::migratepaps(const uint32_t& max_rows) {
+
+    require_auth( get_self() );
+    check( max_rows > 0, ERR_MAX_ROWS_NOT_POSITIVE, "max_rows must be positive" );
+
+    auto& pap_list = _cache.paps_table();
+    auto& legacy_list = _cache.legacy_paps_table();
+    uint32_t rows = 0;
+    for( auto it = legacy_list.begin(); it != legacy_list.end() && rows < max_rows; ++rows )
+    {
+      migrate_pap(pap_list, legacy_list, *it);
+      it = legacy_list.begin();
+    }
+    if( rows == max_rows )
+      return;
+
+    auto& cfg = _cache.config_table();
+    auto row = cfg.get_or_default();
+    if( !( row.flags & CONFIG_FLAG_PAPS_MIGRATED ) ) {
+      row.flags |= CONFIG_FLAG_PAPS_MIGRATED;
+      cfg.set( row, get_self() );
+    }
+
+    // Legacy table drained: rewrite the rows stored with an older layout.
+    papcursors cursor(get_self(), get_self().value);
+    auto it = pap_list.lower_bound(cursor.get_or_default().next);
+    for( ; it != pap_list.end() && rows < max_rows; ++it, ++rows )
+    {
+      if( !is_latest(it->data) )
+        pap_list.modify(it, same_payer, [&]( auto& r ) {
+          r.set(r.view());
+        });
+    }
+    if( it == pap_list.end() )
+      cursor.remove();
+    else
+      cursor.set({ it->id }, get_self());
+  }
+
+  cristaltoken::pap_page cristaltoken::listprovpaps(const name&                        provider
+                                                   , const std::optional<pap_cursor>&  cursor
+                                                   , const uint32_t&                   limit) {
+
+    check_paps_migrated();
+    auto& pap_list = _cache.paps_table();
+    auto idx = pap_list.get_index<"byprovserv"_n>();
+    return page_paps(idx, &versioned_pap::by_provider_service, provider, cursor, limit);
+  }
+
+  cristaltoken::pap_page cristaltoken::listaccpaps(const name&                         account
+                                                  , const std::optional<pap_cursor>&  cursor
+                                                  , const uint32_t&                   limit) {
+
+    check_paps_migrated();
+    auto& pap_list = _cache.paps_table();
+    auto idx = pap_list.get_index<"byaccserv"_n>();
+    return page_paps(idx, &versioned_pap::by_account_service, account, cursor, limit);
+  }
+
+  // Both byprovserv and byaccserv keep the owner (provider or account) in the upper 64 bits
+  // and the service in the lower ones, so the owner's rows are one contiguous range ordered
+  // by service, then id. The cursor is that position rather than a row, so the walk goes on
+  // from the same place when the row it names is gone.
+  template<typename Index>
+  cristaltoken::pap_page cristaltoken::page_paps(Index&                            idx
+                                                , uint128_t (versioned_pap::*key_of)() const
+                                                , const name&                       owner
+                                                , const std::optional<pap_cursor>&  cursor
+                                                , const uint32_t&                   limit) {
+
+    check( limit > 0, ERR_LIMIT_NOT_POSITIVE, "limit must be positive" );
+
+    auto owns = [&]( const versioned_pap& row ) { return uint64_t((row.*key_of)() >> 64) == owner.value; };
+    auto it = idx.lower_bound(uint128_t{owner.value}<<64);
+    if( cursor ) {
+      const uint128_t key = uint128_t{owner.value}<<64 | cursor->service_id;
+      auto& pap_list = _cache.paps_table();
+      auto resume = pap_list.find(cursor->id);
+      if( resume != pap_list.end() && ((*resume).*key_of)() == key ) {
+        it = idx.iterator_to(*resume);
+      }
+      else {
+        // The row is gone: skip the rows of its service that come before it.
+        it = idx.lower_bound(key);
+        while( it != idx.end() && ((*it).*key_of)() == key && it->id < cursor->id )
+          ++it;
+      }
+    }
+
+    pap_page page;
+    const uint32_t rows = std::min(limit, MAX_QUERY_ROWS);
+    for( ; it != idx.end() && owns(*it); ++it )
+    {
+      if( page.rows.size() == rows ) {
+        page.next = pap_cursor{ it->service_id, it->id };
+        break;
+      }
+      page.rows.push_back(it->view());
+    }
+    return page;
+  }
+
+  cristaltoken::customer_page cristaltoken::listcusts(const name&       cursor
+                                                    , const uint32_t&   limit) {
+
+    check( limit > 0, ERR_LIMIT_NOT_POSITIVE, "limit must be positive" );
+
+    // Rows not migrated yet are listed too: both tables are walked in key order.
+    auto& idx = _cache.customers_table();
+    auto& legacy_idx = _cache.legacy_customers_table();
+    auto it = idx.lower_bound(cursor.value);
+    auto legacy = legacy_idx.lower_bound(cursor.value);
+    auto token = customer_token();
+    customer_page page;
+    const uint32_t rows = std::min(limit, MAX_QUERY_ROWS);
+    while( it != idx.end() || legacy != legacy_idx.end() )
+    {
+      const bool from_legacy = it == idx.end() || ( legacy != legacy_idx.end() && legacy->key < it->key );
+      if( page.rows.size() == rows ) {
+        page.next = from_legacy ? legacy->key : it->key;
+        break;
+      }
+      if( from_legacy )
+        page.rows.push_back((legacy++)->view());
+      else
+        page.rows.push_back((it++)->view(token));
+    }
+    return page;
+  }
+
+  void cristaltoken::prunepaps(const uint32_t& max_rows) {
+
+    require_auth( get_self() );
+    check( max_rows > 0, ERR_MAX_ROWS_NOT_POSITIVE, "max_rows must be positive" );
+    check_paps_migrated();
+    prune_paps( max_rows );
+  }
+
+  // Inactive PAPs sort last in bydue: finished ones first, then blocked ones by disabled_at.
+  // Every row from PAP_DUE_INACTIVE up to the first one blocked within the grace period can
+  // be erased, so active rows and rows to keep are never visited.
+  void cristaltoken::prune_paps(const uint32_t& max_rows) {
+
+    auto& pap_list = _cache.paps_table();
+    auto idx = pap_list.get_index<"bydue"_n>();
+    const uint64_t last = PAP_DUE_INACTIVE + now().sec_since_epoch() - PAP_PRUNE_GRACE;
+    auto it = idx.lower_bound(PAP_DUE_INACTIVE);
+    for( uint32_t rows = 0; it != idx.end() && it->by_due() <= last && rows < max_rows; ++rows ) {
+      move_charge_cursor(*it);
+      it = idx.erase(it);
+    }
+  }
+
+  // Points the chargeall cursor of the walk `row` belongs to at the row after it, or ends
+  // the walk, when `row` is about to be erased.
+  void cristaltoken::move_charge_cursor(const versioned_pap& row) {
+
+    chargecursors cursors(get_self(), row.provider.value);
+    auto cursor = cursors.find(row.service_id);
+    if( cursor == cursors.end() || cursor->next_id != row.id )
+      return;
+
+    auto cidx = _cache.paps_table().get_index<"byprovserv"_n>();
+    auto next = std::next(cidx.iterator_to(row));
+    if( next == cidx.end() || next->by_provider_service() != row.by_provider_service() )
+      cursors.erase(cursor);
+    else
+      cursors.modify(cursor, get_self(), [&]( auto& c ) {
+        c.next_id = next->id;
+      });
+  }
+
+  cristaltoken::paps::const_iterator cristaltoken::find_pap(paps&            pap_list
+                                                          , const name&      account
+                                                          , const name&      provider
+                                                          , const uint32_t&  service_id) {
+
+    auto idxKey = pap::_by_account_service(account, service_id);
+    auto cidx = pap_list.get_index<"byaccserv"_n>();
+    for( auto it = cidx.lower_bound(idxKey); it != cidx.end() && it->by_account_service() == idxKey; ++it )
+    {
+      if( it->provider == provider )
+        return pap_list.iterator_to(*it);
+    }
+
+    // Not migrated yet: move it out of the legacy table on first touch.
+    if( _cache.config_table().get_or_default().flags & CONFIG_FLAG_PAPS_MIGRATED )
+      return pap_list.end();
+    auto& legacy_list = _cache.legacy_paps_table();
+    auto lidx = legacy_list.get_index<"byall"_n>();
+    auto legacy = lidx.find(legacy_pap::_by_account_service_provider(account, provider, service_id));
+    if( legacy == lidx.end() )
+      return pap_list.end();
+    return migrate_pap(pap_list, legacy_list, *legacy);
+  }
+
+  cristaltoken::paps::const_iterator cristaltoken::migrate_pap(paps&               pap_list
+                                                             , legacy_paps&        legacy_list
+                                                             , const legacy_pap&   legacy) {
+
+    check( legacy.periods <= std::numeric_limits<uint16_t>::max(), ERR_PAP_PERIODS_TOO_LARGE, "legacy PAP periods is too large" );
+
+    const bool enabled = legacy.enabled == STATE_ENABLED;
+    auto it = pap_list.emplace(get_self(), [&]( auto& row ) {
+      row.id              = legacy.id;
+      row.account         = legacy.account;
+      row.provider        = legacy.provider;
+      row.service_id      = legacy.service_id;
+      // Blocked before the migration: the grace period starts now.
+      row.set({ legacy.id, legacy.account, legacy.provider, legacy.service_id, legacy.price, legacy.begins_at,
+                uint16_t(legacy.periods), uint16_t(legacy.last_charged), uint8_t(enabled ? PAP_FLAG_ENABLED : 0),
+                enabled ? time_point_sec() : now() });
     });
+    legacy_list.erase(legacy);
+    return it;
+  }
+
+  // Ids stay unique across both tables while legacy rows are still being migrated.
+  uint64_t cristaltoken::next_pap_id(const paps& pap_list) {
+    if( _cache.config_table().get_or_default().flags & CONFIG_FLAG_PAPS_MIGRATED )
+      return pap_list.available_primary_key();
+    auto& legacy_list = _cache.legacy_paps_table();
+    return std::max(pap_list.available_primary_key(), legacy_list.available_primary_key());
+  }
 
+  // Walks over `paps` (chargeall, the list queries, prunepaps) would miss the rows still in
+  // the legacy table. Contracts that never had one need no migratepaps call.
+  bool cristaltoken::paps_migrated() {
+    if( _cache.config_table().get_or_default().flags & CONFIG_FLAG_PAPS_MIGRATED )
+      return true;
+    auto& legacy_list = _cache.legacy_paps_table();
+    return legacy_list.begin() == legacy_list.end();
   }
 
-  void cristaltoken::transfer_impl( const name&    from,
+  void cristaltoken::check_paps_migrated() {
+    check( paps_migrated(), ERR_PAPS_NOT_MIGRATED, "legacy PAPs not migrated yet, run migratepaps" );
+  }
+
+  cristaltoken::transfer_result cristaltoken::transfer_impl( const name&    from,
                         const name&    to,
                         const asset&   quantity,
-                        const string&  memo  ){
+                        const string&  memo,
+                        const bool&    internal,
+                        const uint32_t& debits ){
      
     
-    check( from != to, "cannot transfer to self" );
+    check( from != to, ERR_TRANSFER_TO_SELF, "cannot transfer to self" );
     // check( has_auth(from) || has_auth(get_self()), "Missing required authority of owner or admin");
     
-    check( is_account( to ), "to account does not exist");
+    check( is_account( to ), ERR_TO_ACCOUNT_NOT_FOUND, "to account does not exist" );
     
     auto sym = quantity.symbol.code();
-    stats statstable( get_self(), sym.raw() );
-    const auto& st = statstable.get( sym.raw() );
+    auto& statstable = _cache.stats_of( sym );
+    auto existing = statstable.find( sym.raw() );
+    check( existing != statstable.end(), ERR_TOKEN_NOT_FOUND, "token with symbol does not exist" );
+    const auto& st = *existing;
 
-    require_recipient( from );
-    require_recipient( to );
-    check( quantity.is_valid(), "invalid quantity" );
-    check( quantity.amount > 0, "must transfer positive quantity" );
-    check( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
-    check( memo.size() <= 256, "memo has more than 256 bytes" );
+    // Bank initiated transfers skip the customers that opted out of notifications.
+    auto from_customer = find_customer( from );
+    if( !internal || notified( from_customer ) )
+      require_recipient( from );
+    if( !internal || notified( find_customer( to ) ) )
+      require_recipient( to );
+    check( quantity.is_valid(), ERR_INVALID_QUANTITY, "invalid quantity" );
+    check( quantity.amount > 0, ERR_TRANSFER_NOT_POSITIVE, "must transfer positive quantity" );
+    check( quantity.symbol == st.supply.symbol, ERR_SYMBOL_PRECISION_MISMATCH, "symbol precision mismatch" );
+    check( memo.size() <= 256, ERR_MEMO_TOO_LONG, "memo has more than 256 bytes" );
 
     // auto payer = has_auth( to ) ? to : from;
     auto payer = get_self();
 
-    sub_balance( from, quantity );
-    add_balance( to, quantity, payer );
+    // The fee is owed per debit: a catch-up charge counts one per period.
+    auto fee = customer_fee( from_customer, quantity.symbol ) * debits;
+    transfer_result result;
+    result.from_balance = sub_balance( from, quantity + fee, credit_limit( from_customer, quantity.symbol ) );
+    result.to_balance   = add_balance( to, quantity, payer );
+    if( fee.amount > 0 )
+      accrue_fee( fee );
+    return result;
     
   }
 
+  // Fee owed by `owner` per debit of `sym`: the customer fee when it is of the same token,
+  // zero otherwise (non customers, fees in another token).
+  asset cristaltoken::customer_fee( const name& owner, const symbol& sym ) {
+    return customer_fee( find_customer( owner ), sym );
+  }
+
+  asset cristaltoken::customer_fee( const std::optional<customer>& c, const symbol& sym ) {
+    if( !c || c->fee.symbol != sym || c->fee.amount <= 0 )
+      return asset( 0, sym );
+    return c->fee;
+  }
+
+  // Amount a customer may overdraw in `sym`: the overdraft of an enabled customer when it is
+  // of the same token and a credit line, zero otherwise (non customers, and customers whose
+  // overdraft was issued as tokens and is not retired yet, see retire_overdraft).
+  int64_t cristaltoken::credit_limit( const std::optional<customer>& c, const symbol& sym ) {
+    if( !c || !( c->flags & CUST_FLAG_CREDIT_LINE ) || c->state != STATE_ENABLED || c->overdraft.symbol != sym )
+      return 0;
+    return c->overdraft.amount;
+  }
+
+  // Customers created before the overdraft became a credit line had it issued to their
+  // balance (memo "oft|create"). `issued` is debited back out and retired from the supply
+  // once, by retireoft; from then on the overdraft is only honoured as a credit line.
+  void cristaltoken::retire_overdraft( customer& row, const asset& issued ) {
+    row.flags |= CUST_FLAG_CREDIT_LINE;
+    if( issued.amount == 0 )
+      return;
+
+    auto& statstable = _cache.stats_of( issued.symbol.code() );
+    auto st = statstable.find( issued.symbol.code().raw() );
+    check( st != statstable.end(), ERR_TOKEN_NOT_FOUND, "token with symbol does not exist" );
+    check( st->supply.symbol == issued.symbol, ERR_SYMBOL_PRECISION_MISMATCH, "symbol precision mismatch" );
+
+    statstable.modify( st, same_payer, [&]( auto& s ) {
+       s.supply -= issued;
+    });
+    // Without the credit line the balance is not negative, so the debit leaves it within
+    // -issued, whatever the customer state.
+    sub_balance( row.key, issued, issued.amount );
+  }
+
+  void cristaltoken::accrue_fee( const asset& fee ) {
+    auto& pool = _cache.feepools_table();
+    auto it = pool.find( fee.symbol.code().raw() );
+    if( it == pool.end() ) {
+      pool.emplace( get_self(), [&]( auto& row ) {
+        row.accrued = fee;
+      });
+    } else {
+      pool.modify( it, same_payer, [&]( auto& row ) {
+        row.accrued += fee;
+      });
+    }
+  }
+
+  void cristaltoken::settlefees(const name&          to
+                                , const symbol_code& sym
+                                , const string&      memo) {
+
+    check( memo.size() <= 256, ERR_MEMO_TOO_LONG, "memo has more than 256 bytes" );
+    require_auth(get_self());
+
+    auto admin = find_customer(to);
+    check( admin.has_value(), ERR_CUSTOMER_NOT_FOUND, "Customer account not exists." );
+    check( admin->account_type == TYPE_ACCOUNT_BANK_ADMIN, ERR_NOT_ADMIN, "Account is not ADMIN." );
+
+    auto& pool = _cache.feepools_table();
+    auto it = pool.find( sym.raw() );
+    check( it != pool.end() && it->accrued.amount > 0, ERR_NO_FEES_TO_SETTLE, "no fees to settle" );
+
+    if( admin->notify() )
+      require_recipient( to );
+    add_balance( to, it->accrued, get_self() );
+
+    // The row is kept (zeroed) so the next accrual is an update, not a new row.
+    pool.modify( it, same_payer, [&]( auto& row ) {
+      row.accrued.amount = 0;
+    });
+  }
+
 
   void cristaltoken::upsertcust(const name&       to
                               , const asset&      fee
@@ -362,51 +1030,257 @@ namespace eosio {
                               , const uint32_t&   state
                               , const string& memo) {
       
-    check( memo.size() <= 256, "memo has more than 256 bytes" );
+    check( memo.size() <= 256, ERR_MEMO_TOO_LONG, "memo has more than 256 bytes" );
     require_auth(get_self());
-    customers idx(get_self(), get_first_receiver().value);
-    auto iterator = idx.find(to.value);
-    if( iterator == idx.end() )
-    {
-      idx.emplace(get_self(), [&]( auto& row ) {
-        row.key               = to;
-        row.fee               = fee;
-        row.overdraft         = overdraft;
-        row.account_type      = account_type;
-        row.state             = state;
-      });
+    upsert_customer({ to, fee, overdraft, account_type, state }, customer_token());
+  }
 
-      if(overdraft.amount>0)
-      {
-        std::string memo = "oft|create";
-        SEND_INLINE_ACTION( *this, issue, { {get_self(), "active"_n} },
-                            { to, overdraft, memo }
-        );
-      }
-    }
-    else {
-      // update
-      idx.modify(iterator, get_self(), [&]( auto& row ) {
-        // row.key               = to;
-        row.fee               = fee;
-        row.overdraft         = overdraft; // We should withdraw tokens if new overdraft is minor than old one.
-        row.account_type      = account_type;
-        row.state             = state;
-      });
-    }
+  void cristaltoken::upsertcusts(const std::vector<customer_record>& customers) {
+
+    require_auth(get_self());
+    check( !customers.empty(), ERR_NO_CUSTOMERS, "no customers to upsert" );
+
+    auto token = customer_token();
+    for( const auto& record : customers )
+      upsert_customer(record, token);
+  }
+
+  // The overdraft is a credit line honoured by sub_balance: no tokens are issued for it, so
+  // new customers get CUST_FLAG_CREDIT_LINE. The flags of existing customers are kept.
+  void cristaltoken::upsert_customer(const customer_record& record, const symbol& token) {
+
+    check( record.overdraft.is_valid() && record.overdraft.amount >= 0, ERR_INVALID_OVERDRAFT, "invalid overdraft" );
+    store_customer({ record.to, record.fee, record.overdraft, record.account_type, record.state, CUST_FLAG_CREDIT_LINE }, token, true);
+  }
+
+  void cristaltoken::setnotify(const name&   to
+                             , const bool&   notify) {
+
+    check( has_auth(get_self()) || has_auth(to), ERR_MISSING_ADMIN_OR_CUSTOMER, "Missing required authority of admin or customer" );
+    auto row = find_customer(to);
+    check( row.has_value(), ERR_CUSTOMER_NOT_FOUND, "Account does not exist" );
+    if( notify )
+      row->flags &= ~CUST_FLAG_NO_NOTIFY;
+    else
+      row->flags |= CUST_FLAG_NO_NOTIFY;
+    store_customer(*row, customer_token());
   }
 
   void cristaltoken::erasecust(const name& to
                               , const string& memo) {
       
-    check( memo.size() <= 256, "memo has more than 256 bytes" );
+    check( memo.size() <= 256, ERR_MEMO_TOO_LONG, "memo has more than 256 bytes" );
     require_auth(get_self());
-    customers idx(get_self(), get_first_receiver().value);
+    auto& idx = _cache.customers_table();
     auto iterator = idx.find(to.value);
-    check(iterator != idx.end(), "Account does not exist");
-    idx.erase(iterator);
+    if( iterator != idx.end() ) {
+      idx.erase(iterator);
+      return;
+    }
+    auto& legacy_idx = _cache.legacy_customers_table();
+    auto legacy = legacy_idx.find(to.value);
+    check(legacy != legacy_idx.end(), ERR_CUSTOMER_NOT_FOUND, "Account does not exist" );
+    legacy_idx.erase(legacy);
     
   }
 
-  
+  void cristaltoken::migratecusts(const uint32_t& max_rows) {
+
+    require_auth( get_self() );
+    check( max_rows > 0, ERR_MAX_ROWS_NOT_POSITIVE, "max_rows must be positive" );
+
+    auto& idx = _cache.customers_table();
+    auto& legacy_idx = _cache.legacy_customers_table();
+    uint32_t rows = 0;
+    auto token = customer_token();
+    for( auto legacy = legacy_idx.begin(); legacy != legacy_idx.end() && rows < max_rows; ++rows )
+    {
+      auto row = legacy->view();
+      legacy = legacy_idx.erase(legacy);
+      idx.emplace(get_self(), [&]( auto& r ) {
+        r.key = row.key;
+        r.set(row, token);
+      });
+    }
+    if( rows == max_rows )
+      return;
+
+    auto& cfg = _cache.config_table();
+    auto config_row = cfg.get_or_default();
+    if( !( config_row.flags & CONFIG_FLAG_CUSTS_MIGRATED ) ) {
+      config_row.flags |= CONFIG_FLAG_CUSTS_MIGRATED;
+      cfg.set( config_row, get_self() );
+    }
+
+    // Legacy table drained: rewrite the rows stored with an older layout. Rows the packed
+    // layout cannot hold stay customer_v1 and are only rewritten if still customer_v0.
+    custcursors cursor(get_self(), get_self().value);
+    auto it = idx.lower_bound(cursor.get_or_default().next.value);
+    for( ; it != idx.end() && rows < max_rows; ++it, ++rows )
+    {
+      auto row = it->view(token);
+      if( !it->packed() && ( customer_v2::fits(row, token) || it->data.index() == 0 ) )
+        idx.modify(it, same_payer, [&]( auto& r ) {
+          r.set(row, token);
+        });
+    }
+    if( it == idx.end() )
+      cursor.remove();
+    else
+      cursor.set({ it->key }, get_self());
+  }
+
+  void cristaltoken::retireoft(const std::vector<issued_overdraft>& overdrafts) {
+
+    require_auth( get_self() );
+    check( !overdrafts.empty(), ERR_NO_OVERDRAFTS, "no overdrafts to retire" );
+
+    auto token = customer_token();
+    for( const auto& o : overdrafts ) {
+      auto row = find_customer( o.to );
+      check( row.has_value(), ERR_CUSTOMER_NOT_FOUND, "Account does not exist" );
+      check( !( row->flags & CUST_FLAG_CREDIT_LINE ), ERR_OVERDRAFT_RETIRED, "overdraft already a credit line" );
+      check( o.quantity.is_valid() && o.quantity.amount >= 0, ERR_INVALID_QUANTITY, "invalid quantity" );
+      retire_overdraft( *row, o.quantity );
+      store_customer( *row, token );
+    }
+  }
+
+  // Customer `owner` whatever the layout of its row, also while it is still in the legacy
+  // `customer` table. Read only: rows are upgraded when written (see store_customer).
+  // Once migratecusts has drained the legacy table, non customers cost a single lookup.
+  std::optional<cristaltoken::customer> cristaltoken::find_customer( const name& owner ) {
+    auto cfg = _cache.config_table().get_or_default();
+    auto& idx = _cache.customers_table();
+    auto it = idx.find( owner.value );
+    if( it != idx.end() )
+      return it->view( cfg.token );
+    if( cfg.flags & CONFIG_FLAG_CUSTS_MIGRATED )
+      return std::nullopt;
+
+    auto& legacy_idx = _cache.legacy_customers_table();
+    auto legacy = legacy_idx.find( owner.value );
+    if( legacy != legacy_idx.end() )
+      return legacy->view();
+    return std::nullopt;
+  }
+
+  // Writes `row` with the newest layout that holds it, moving it out of the legacy table on
+  // first write. With `keep_flags` the flags of the stored customer, if any, are kept.
+  void cristaltoken::store_customer( customer row, const symbol& token, bool keep_flags ) {
+    auto& idx = _cache.customers_table();
+    auto it = idx.find( row.key.value );
+    if( it != idx.end() ) {
+      idx.modify( it, get_self(), [&]( auto& r ) {
+        if( keep_flags )
+          row.flags = r.view( token ).flags;
+        r.set( row, token );
+      });
+      return;
+    }
+
+    // Legacy rows have no flags to keep: their overdraft is still issued (see retire_overdraft).
+    if( !( _cache.config_table().get_or_default().flags & CONFIG_FLAG_CUSTS_MIGRATED ) ) {
+      auto& legacy_idx = _cache.legacy_customers_table();
+      auto legacy = legacy_idx.find( row.key.value );
+      if( legacy != legacy_idx.end() ) {
+        legacy_idx.erase( legacy );
+        if( keep_flags )
+          row.flags = 0;
+      }
+    }
+    idx.emplace( get_self(), [&]( auto& r ) {
+      r.key = row.key;
+      r.set( row, token );
+    });
+  }
+
+  // Token of the amounts of packed customer rows: the contract token, which setconfig does
+  // not let change once set. Without it no row is packed.
+  symbol cristaltoken::customer_token() {
+    return _cache.config_table().get_or_default().token;
+  }
+
+
+  cristaltoken::configs& cristaltoken::action_cache::config_table() {
+    if( !_configs )
+      _configs.emplace( _self, _self.value );
+    return *_configs;
+  }
+
+  cristaltoken::stats& cristaltoken::action_cache::stats_of( const symbol_code& sym ) {
+    auto it = _stats.find( sym.raw() );
+    if( it == _stats.end() )
+      it = _stats.emplace( std::piecewise_construct,
+                           std::forward_as_tuple( sym.raw() ),
+                           std::forward_as_tuple( _self, sym.raw() ) ).first;
+    return it->second;
+  }
+
+  cristaltoken::accounts& cristaltoken::action_cache::accounts_of( const name& owner ) {
+    auto it = _accounts.find( owner.value );
+    if( it == _accounts.end() )
+      it = _accounts.emplace( std::piecewise_construct,
+                              std::forward_as_tuple( owner.value ),
+                              std::forward_as_tuple( _self, owner.value ) ).first;
+    return it->second;
+  }
+
+  cristaltoken::holders& cristaltoken::action_cache::holders_of( const symbol_code& sym ) {
+    auto it = _holders.find( sym.raw() );
+    if( it == _holders.end() )
+      it = _holders.emplace( std::piecewise_construct,
+                             std::forward_as_tuple( sym.raw() ),
+                             std::forward_as_tuple( _self, sym.raw() ) ).first;
+    return it->second;
+  }
+
+  cristaltoken::auditstates& cristaltoken::action_cache::audits_of( const symbol_code& sym ) {
+    auto it = _audits.find( sym.raw() );
+    if( it == _audits.end() )
+      it = _audits.emplace( std::piecewise_construct,
+                            std::forward_as_tuple( sym.raw() ),
+                            std::forward_as_tuple( _self, sym.raw() ) ).first;
+    return it->second;
+  }
+
+  std::optional<cristaltoken::auditstate>& cristaltoken::action_cache::audit_state( const symbol_code& sym ) {
+    auto it = _audit_states.find( sym.raw() );
+    if( it == _audit_states.end() ) {
+      auto& audits = audits_of( sym );
+      it = _audit_states.emplace( sym.raw(), audits.exists() ? std::optional<auditstate>( audits.get() ) : std::nullopt ).first;
+    }
+    return it->second;
+  }
+
+  cristaltoken::customers& cristaltoken::action_cache::customers_table() {
+    if( !_customers )
+      _customers.emplace( _self, _first_receiver.value );
+    return *_customers;
+  }
+
+  cristaltoken::legacy_customers& cristaltoken::action_cache::legacy_customers_table() {
+    if( !_legacy_customers )
+      _legacy_customers.emplace( _self, _first_receiver.value );
+    return *_legacy_customers;
+  }
+
+  cristaltoken::feepools& cristaltoken::action_cache::feepools_table() {
+    if( !_feepools )
+      _feepools.emplace( _self, _self.value );
+    return *_feepools;
+  }
+
+  cristaltoken::paps& cristaltoken::action_cache::paps_table() {
+    if( !_paps )
+      _paps.emplace( _self, _first_receiver.value );
+    return *_paps;
+  }
+
+  cristaltoken::legacy_paps& cristaltoken::action_cache::legacy_paps_table() {
+    if( !_legacy_paps )
+      _legacy_paps.emplace( _self, _first_receiver.value );
+    return *_legacy_paps;
+  }
+
 } /// namespace eosio